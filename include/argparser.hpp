@@ -1,10 +1,13 @@
 #ifndef ARGPARSER_H
 #define ARGPARSER_H
 
+#include <map>
 #include <string>
 #include <vector>
+#include <memory>
 #include <getopt.h>
 #include "quoter.hpp"
+#include "sketchquoter.hpp"
 
 namespace ArgParser {
 	const struct option opts_long[]={
@@ -16,30 +19,95 @@ namespace ArgParser {
 		{"merge",     required_argument, NULL, 'm'},
 		{"feed",      required_argument, NULL, 'f'},
 		{"build",     no_argument,       NULL, 'b'},
+		{"external",  required_argument, NULL, 'e'},
+		{"tempdir",   required_argument, NULL, 'T'},
+		{"approximate", required_argument, NULL, 'a'},
+		{"tokenize",  required_argument, NULL, 'k'},
+		{"jobs",      required_argument, NULL, 'j'},
+		{"dictionary", required_argument, NULL, 'd'},
+		{"max-words", required_argument, NULL, 'w'},
+		{"profile",   required_argument, NULL, 'p'},
+		{"checkpoint", required_argument, NULL, 'c'},
 		{0, 0, 0, 0}
 	};
 
-	void parseArgs(int argc, char **argv);
+	struct FeedSettings {
+		// Bytes of memory an out-of-core feed may use.
+		// Zero means feeds are counted in memory.
+		std::size_t externalBudget;
+		// Directory out-of-core feeds spill their runs to.
+		std::string tempDir;
+		// Tokenizer threads of pipelined feeds.
+		// Zero means feeds are read sequentially.
+		unsigned int tokenizers;
+		// Bytes read between checkpoints of a feed.
+		// Zero means feeds aren't checkpointed.
+		std::size_t checkpointInterval;
+		// Number of checkpointed feeds into each stashed
+		// quoter, by save file.
+		std::map<std::string, unsigned int> checkpoints;
+	};
+
+	int parseArgs(int argc, char **argv);
 	void option_new(int argc, char **argv,
 			std::vector<std::pair<Quoter, std::string>>& stash,
+			std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+		        const std::shared_ptr<Dictionary>& sharedDict,
 		        bool strictMode, bool& strictMode_exit);
 	void option_load(int argc, char **argv,
 			 std::vector<std::pair<Quoter, std::string>>& stash,
+			 std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
 			 bool strictMode, bool& strictMode_exit);
 	void option_overwrite(int argc, char **argv,
 			 std::vector<std::pair<Quoter, std::string>>& stash,
+			 std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			 const std::shared_ptr<Dictionary>& sharedDict,
 			 bool strictMode, bool& strictMode_exit);
 	void option_merge(int argc, char **argv,
 			  std::vector<std::pair<Quoter, std::string>>& stash,
+			  std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			  const std::shared_ptr<Dictionary>& sharedDict,
 			  bool strictMode, bool& strictMode_exit);
 	void option_feed(int argc, char **argv,
 			 std::vector<std::pair<Quoter, std::string>>& stash,
+			 std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			 FeedSettings& feedSettings,
 			 bool strictMode, bool& strictMode_exit);
 	void option_build(int argc, char **argv,
 			  std::vector<std::pair<Quoter, std::string>>& stash,
+			  std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			  std::size_t maxWords,
 			  bool strictMode, bool& strictMode_exit);
+	void option_profile(int argc, char **argv,
+			    std::vector<std::pair<Quoter, std::string>>& stash,
+			    std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			    std::size_t maxWords,
+			    bool strictMode, bool& strictMode_exit);
+	void option_maxWords(int argc, char **argv, std::size_t& maxWords,
+			     bool strictMode, bool& strictMode_exit);
+	void option_approximate(int argc, char **argv,
+				std::vector<std::pair<Quoter, std::string>>& stash,
+				std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+				bool strictMode, bool& strictMode_exit);
+	void option_tokenize(int argc, char **argv,
+			     bool strictMode, bool& strictMode_exit);
+	void option_dictionary(int argc, char **argv,
+			       std::shared_ptr<Dictionary>& sharedDict,
+			       bool strictMode, bool& strictMode_exit);
+	void option_external(int argc, char **argv, FeedSettings& feedSettings,
+			     bool strictMode, bool& strictMode_exit);
+	void option_jobs(int argc, char **argv, FeedSettings& feedSettings,
+			 bool strictMode, bool& strictMode_exit);
+	void option_tempdir(int argc, char **argv, FeedSettings& feedSettings,
+			    bool strictMode, bool& strictMode_exit);
+	void option_checkpoint(int argc, char **argv, FeedSettings& feedSettings,
+			       bool strictMode, bool& strictMode_exit);
+	bool parseSize(const char *str, std::size_t& size);
+	std::string journalPath(const std::string& saveFile, unsigned int feed);
         bool filenameInStash(std::vector<std::pair<Quoter, std::string>>& stash,
 			     const std::string& filename);
+	bool filenameInStash(std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			     const std::string& filename);
 }
 
 #endif //ARGPARSER_H
@@ -0,0 +1,122 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spscqueue.hpp"
+#include "tokencache.hpp"
+#include "tokenizer.hpp"
+
+/*
+ * Journal of a feed in progress, so that an interrupted feed can resume
+ * where it left off instead of starting over.
+ *
+ * A journal holds a fixed size header and a sequence of deltas. The
+ * header records the source file's name, size and modification time,
+ * the tokenizer's fingerprint and a fingerprint of the quoter's state
+ * before the feed. A journal whose header doesn't match the feed is
+ * never read. All fields of the header are in the host's byte order.
+ *
+ * Each delta holds the counts added and the words interned since the
+ * previous delta, along with how far into the source the feed had got.
+ * Its counts are stored as the records of a run file, and its other
+ * fields as base-128 varints. Deltas are prefixed with their length and
+ * followed by a checksum, so a delta cut short by a crash is dropped.
+ *
+ * Deltas are encoded and appended on a background thread, so writing a
+ * checkpoint doesn't hold up counting.
+ */
+class Checkpoint {
+public:
+	struct Delta {
+		// Bytes of the source read so far.
+		std::uint64_t offset;
+		// Sentence state at offset.
+		Tokenizer::State state;
+		// Row of the last item counted, or UINT32_MAX if none.
+		std::uint32_t lastCol;
+		// Whether the feed is complete.
+		bool finished;
+		// Id of the first word in words.
+		std::uint32_t firstId;
+		// Words interned since the previous delta, in order of id.
+		std::vector<std::string> words;
+		// Packed pairs counted since the previous delta. When
+		// written, duplicates are summed. When read, pairs are
+		// distinct and ascending, and counts holds their counts.
+		std::vector<std::uint64_t> pairs;
+		std::vector<std::uint64_t> counts;
+	};
+
+	/* Opens the journal of a feed. An existing journal is only
+	 * resumed from if it was written by the same feed.
+	 *
+	 * @param path Path to the journal.
+	 * @param source Path to the file being fed.
+	 * @param base Fingerprint of the quoter's state before the feed.
+	 */
+	Checkpoint(const std::string& path, const std::string& source,
+		   std::uint64_t base);
+
+	/* Stops the background thread. Deltas not yet written are lost,
+	 * but the journal is left intact.
+	 */
+	~Checkpoint();
+
+	/* Reads the next delta of the feed from the journal. Once this
+	 * returns false, new deltas may be written.
+	 *
+	 * @param delta Replaced by the delta read.
+	 * @return False once all complete deltas have been read.
+	 */
+	bool resume(Delta& delta);
+
+	/* Queues a delta to be appended to the journal. Waits if the
+	 * background thread is more than a couple of deltas behind.
+	 *
+	 * @param delta Delta to write. Its pairs and words are moved from.
+	 */
+	void write(Delta& delta);
+
+	/* Waits for every queued delta to be written and closes the
+	 * journal. The last delta written should be finished.
+	 */
+	void close();
+private:
+	struct Header {
+		char magic[4];
+		std::uint32_t version;
+		TokenCache::SourceStamp source;
+		std::uint64_t sourceName;
+		std::uint64_t base;
+	};
+
+	std::string filename;
+	Header header;
+	std::ifstream in;
+	// End of the last complete delta read.
+	std::uint64_t validEnd;
+	std::uint64_t journalSize;
+
+	std::FILE *out;
+	std::unique_ptr<SpscQueue<Delta>> queue;
+	std::thread writer;
+	std::atomic<bool> stop;
+	std::atomic<bool> failed;
+	// Whether the finished delta has been queued.
+	bool done;
+
+	void open();
+	void writeLoop();
+	void append(Delta& delta);
+	static Header sourceHeader(const std::string& source,
+				   std::uint64_t base);
+};
+
+#endif //CHECKPOINT_H
@@ -0,0 +1,91 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Interned words of one or more quoters, indexed by id. Ids below
+ * Markers::NUM_ITEMS belong to the sentence markers and have empty
+ * words. Words are only ever added, so ids never change.
+ *
+ * A dictionary is either private to a single quoter, or shared between
+ * quoters through a sidecar file that their save files refer to.
+ */
+class Dictionary {
+public:
+	/* Creates a private dictionary holding only the markers.
+	 */
+	Dictionary();
+
+	/* Looks up a word, adding it if it's new.
+	 *
+	 * @param word Word to look up. Must not be empty.
+	 * @return Id of the word.
+	 */
+	std::uint32_t intern(const std::string& word);
+
+	/* @param id Id of a word.
+	 * @return The word.
+	 */
+	const std::string& word(std::uint32_t id) const;
+
+	/* @return Number of ids in use, including the markers.
+	 */
+	std::size_t size() const;
+
+	/* @return Absolute path of the sidecar file, or an empty string
+	 *         if the dictionary is private.
+	 */
+	const std::string& path() const;
+
+	/* @param saveFile Path of a save file referring to the dictionary.
+	 * @return Path of the sidecar file relative to the directory of
+	 *         saveFile.
+	 */
+	std::string pathFrom(const std::string& saveFile) const;
+
+	/* Writes a shared dictionary to its sidecar file, unless no
+	 * words were added since it was last read or written. Other
+	 * processes may share the sidecar. Words they saved after this
+	 * dictionary's are taken on. If they saved different words under
+	 * ids this dictionary uses, QuoterError is thrown and the sidecar
+	 * is left alone.
+	 */
+	void save();
+
+	/* Returns the shared dictionary stored at a path. Every caller
+	 * gets the same dictionary for as long as one of them holds it,
+	 * however the path is spelled. It is read from the sidecar file
+	 * if one exists.
+	 *
+	 * @param filename Path of the sidecar file.
+	 * @return The shared dictionary.
+	 */
+	static std::shared_ptr<Dictionary> open(const std::string& filename);
+
+	/* Resolves the dictionary path of a save file.
+	 *
+	 * @param path Path as stored in the save file.
+	 * @param saveFile Path of the save file.
+	 * @return path, taken relative to the directory of saveFile
+	 *         unless it is absolute.
+	 */
+	static std::string resolve(const std::string& path,
+				   const std::string& saveFile);
+private:
+	std::vector<std::string> words;
+	std::unordered_map<std::string, std::uint32_t> index;
+	std::string filename;
+	// Number of words in the sidecar file.
+	std::size_t savedSize;
+
+	void saveLocked();
+	void readData(std::string path);
+	static std::vector<std::string> readWords(const std::string& path);
+	static std::string canonicalPath(const std::string& path);
+};
+
+#endif //DICTIONARY_H
@@ -0,0 +1,31 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <string>
+
+// Offset basis of 64-bit FNV-1a, the hash of no bytes.
+static const std::uint64_t FNV1A_BASIS = 0xcbf29ce484222325ULL;
+
+/* Hashes bytes with 64-bit FNV-1a. Not suited to anything adversarial,
+ * but fast and stable across builds and hosts of the same byte order.
+ *
+ * @param data Bytes to hash.
+ * @param len Number of bytes.
+ * @param h Hash to continue from, so data can be hashed in pieces.
+ * @return Hash of the bytes hashed so far.
+ */
+inline std::uint64_t fnv1a(const void *data, std::size_t len,
+			   std::uint64_t h = FNV1A_BASIS) {
+	const unsigned char *p = (const unsigned char *)data;
+	for (std::size_t i = 0; i < len; i++)
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+inline std::uint64_t fnv1a(const std::string& s,
+			   std::uint64_t h = FNV1A_BASIS) {
+	return fnv1a(s.data(), s.size(), h);
+}
+
+#endif //HASH_H
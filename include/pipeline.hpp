@@ -0,0 +1,46 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "tokenizer.hpp"
+
+/*
+ * Staged ingest of a text stream. A reader thread reads the stream in
+ * blocks cut at whitespace. Tokenizer threads split the blocks into
+ * words and scan them. The calling thread receives the scanned words
+ * in stream order. Stages hand batches to each other through bounded
+ * lock-free queues, so reading, scanning and counting overlap.
+ *
+ * The stream is only read sequentially, so pipes and standard input
+ * work as well as files.
+ */
+namespace Pipeline {
+	/* Runs a stream through the pipeline.
+	 *
+	 * @param in Stream of coherent text.
+	 * @param tokenizers Number of tokenizer threads. At least one is used.
+	 * @param consume Called on the calling thread with each batch of
+	 *                scanned words, in stream order. It may move from
+	 *                the words.
+	 */
+	void run(std::istream& in, unsigned int tokenizers,
+		 const std::function<void(std::vector<Tokenizer::Word>&)>& consume);
+
+	/* Runs a stream through the pipeline and a single sentence state,
+	 * and hands the resulting parser items to several consumers, so a
+	 * stream is only read and tokenized once however many quoters are
+	 * fed from it. Each consumer sees every item of the stream, in
+	 * order, as it would from feeding the stream by itself.
+	 *
+	 * @param in Stream of coherent text.
+	 * @param tokenizers Number of tokenizer threads. At least one is used.
+	 * @param consumers Called in turn on the calling thread with each
+	 *                  batch of items. They must not change the items.
+	 */
+	void feed(std::istream& in, unsigned int tokenizers,
+		  const std::vector<std::function<void(std::vector<Tokenizer::Item>&)>>& consumers);
+}
+
+#endif //PIPELINE_H
@@ -5,9 +5,15 @@
 #include <exception>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <random>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include "dictionary.hpp"
+#include "runfile.hpp"
+#include "tokenizer.hpp"
 
 class QuoterError: public std::exception {
 public:
@@ -21,31 +27,124 @@ class Quoter {
 public:
 	Quoter();
 
+	/* Creates a quoter whose words are looked up in a dictionary that
+	 * may be shared with other quoters. The bigram array still only
+	 * has rows for the words this quoter has seen.
+	 *
+	 * @param dict Dictionary to use.
+	 */
+	Quoter(std::shared_ptr<Dictionary> dict);
+
+	/* Copies a quoter. A private dictionary is copied along with it,
+	 * while a shared one stays shared.
+	 */
+	Quoter(const Quoter& other);
+	Quoter(Quoter&& other) = default;
+
 	/* Feed a stream of coherent text into quoter for it to mimic.
 	 *
 	 * @param in Stream of coherent text.
 	 */
 	void feed_stream(std::istream& in);
 
+	/* Counts parser items into the quoter as feed_stream would, for
+	 * feeding several quoters from one pass over a stream with
+	 * Pipeline::feed. Take one counter per stream, since it keeps
+	 * track of the last item counted.
+	 *
+	 * @return Function to call with each batch of items, in order.
+	 */
+	std::function<void(std::vector<Tokenizer::Item>&)> itemCounter();
+
 	/* Feeds a file containing coherent text into a quoter for it to mimic.
 	 *
 	 * @param filePath Path to file containing coherent text.
 	 */
 	void feed_file(std::string filePath);
 
+	/* Feeds a file into a quoter without holding its bigram pairs in
+	 * memory. Pairs are collected into a buffer of at most memoryBudget
+	 * bytes, which is spilled to tempDir as a sorted, compressed run
+	 * whenever it fills up. The runs are then merged into a single run
+	 * of counts that stays in tempDir. It is only loaded into the array
+	 * once the counts are needed in memory, and writeData streams it
+	 * into the save file otherwise. The result is the same as that of
+	 * feed_file. If the feed fails, the counts of earlier feeds are
+	 * kept.
+	 *
+	 * @param filePath Path to file containing coherent text.
+	 * @param tempDir Directory to spill runs to.
+	 * @param memoryBudget Bytes of memory to use for buffering pairs
+	 *                     and merging runs.
+	 */
+	void feed_file_external(std::string filePath, std::string tempDir,
+				std::size_t memoryBudget);
+
+	/* Feeds a file into a quoter, writing checkpoints to a journal
+	 * every interval bytes of the file. Checkpoints are incremental
+	 * and written in the background. If the journal holds checkpoints
+	 * of the same file fed into the same quoter state, they are
+	 * replayed and the file is read from the last one on. The result
+	 * is the same as that of feed_file. The journal is kept once the
+	 * feed is complete, so that it can still be resumed from until
+	 * the quoter has been written. If this throws, part of the file
+	 * may have been counted, but the checkpoints already in the
+	 * journal can still be resumed from.
+	 *
+	 * @param filePath Path to file containing coherent text.
+	 * @param journalPath Path to the journal.
+	 * @param interval Bytes of the file to read between checkpoints.
+	 * @return Bytes of the file skipped by resuming.
+	 */
+	std::uint64_t feed_file_checkpointed(std::string filePath,
+					     std::string journalPath,
+					     std::size_t interval);
+
+	/* Feeds a file from its token cache instead of its text. The
+	 * result is the same as that of feed_file.
+	 *
+	 * @param filePath Path to file the cache was built from.
+	 */
+	void feed_cache(std::string filePath);
+
 	/* Feed a string of coherent text into a quoter for it to mimic.
 	 *
 	 * @param text String of coherent text.
 	 */
 	void feed_string(std::string text);
 
+	/* Adds the counts of another quoter to this one. If both use the
+	 * same dictionary, this is plain count addition. Otherwise the
+	 * words of other are looked up in this quoter's dictionary first.
+	 *
+	 * @param other Quoter to merge in.
+	 */
+	void merge(const Quoter& other);
+
+	/* @return The dictionary this quoter looks its words up in.
+	 */
+	std::shared_ptr<Dictionary> getDictionary() const;
+
 	/* Builds a sentence based on the text fed into a quoter.
 	 *
 	 * @return A single sentence.
 	 */
 	std::string buildSentence();
 
-	/* Writes quoter data to a file.
+	/* Builds a sentence of bounded length. Words that no sentence end
+	 * can be reached from are never picked, so a sentence always can
+	 * end. Throws QuoterError if the quoter has nothing to build from.
+	 *
+	 * @param maxWords Maximum number of words, or 0 for no limit.
+	 * @param truncate Whether to end a sentence with a period once it
+	 *                 reaches maxWords. Otherwise QuoterError is thrown.
+	 * @return A single sentence.
+	 */
+	std::string buildSentence(std::size_t maxWords, bool truncate);
+
+	/* Writes quoter data to a file. If the quoter's dictionary is
+	 * shared, the file refers to the dictionary's sidecar file instead
+	 * of listing the words, and the sidecar is written too if needed.
 	 *
 	 * @param filename Name of file to write to.
 	 */
@@ -62,39 +161,10 @@ public:
 	 */
 	void emitArray();
 private:
-	enum struct Markers: std::uint32_t {
-		START,
-		PERIOD,
-		EXCLAIM,
-		QUESTION,
-		NUM_ITEMS
-	};
-
-	enum struct ParserItemTypes: std::uint32_t {
-		MARKER,
-		WORD
-	};
-
-	struct ParserItem {
-		ParserItemTypes type;
-	};
-
-	struct ParserItem_marker: ParserItem {
-		Markers marker;
-		ParserItem_marker(Markers m) {
-			type=ParserItemTypes::MARKER;
-			marker=m;
-		}
-	};
-
-	struct ParserItem_word: ParserItem {
-		std::string word;
-		ParserItem_word(std::string w) {
-			type=ParserItemTypes::WORD;
-			word=w;
-		}
-	};
+	// Fills in the exact quoter it converts to.
+	friend class SketchQuoter;
 
+	typedef Tokenizer::Markers Markers;
 
 	struct save_format_version {
 		std::int16_t major;
@@ -102,21 +172,54 @@ private:
 	};
 
 	const struct save_format_version save_format = {
+		.major = 2,
+		.minor = 2,
+	};
+
+	// Quoters with a private dictionary are saved in the older format,
+	// which is unchanged.
+	const struct save_format_version save_format_private = {
 		.major = 2,
 		.minor = 1,
 	};
 
 	std::default_random_engine randGen;
+	// The array may have fewer rows and columns than the quoter has
+	// words. The missing ones count as zero.
 	std::vector<std::vector<std::uint32_t>> bigram_array;
 	std::vector<std::uint32_t> bigram_rowSums;
-	std::vector<std::string> bigram_words;
+	// Counts fed out of core that aren't in the array yet.
+	std::unique_ptr<RunFile> bigram_pending;
+	std::shared_ptr<Dictionary> dictionary;
+	// Dictionary id of the word of each row. A shared dictionary holds
+	// the words of every quoter sharing it, so rows are numbered per
+	// quoter. Ids of rows whose number differs from their id are also
+	// indexed by id. With a private dictionary, rows are ids.
+	std::vector<std::uint32_t> bigram_ids;
+	std::unordered_map<std::uint32_t, std::uint32_t> bigram_rows;
+	// Whether a sentence end can be reached from each row, and the
+	// counts of each row that lead to such rows. Recomputed by
+	// findReachable whenever the counts have changed.
+	std::vector<bool> bigram_canEnd;
+	std::vector<std::uint64_t> bigram_endSums;
+	bool bigram_reachDirty;
 
 	void checkVersion(struct save_format_version v);
 	struct save_format_version readVersion(std::string buf);
 	void parseData(std::ifstream& in, std::uint64_t& count,
 		       std::vector<std::vector<std::uint32_t>>& vecs,
-		       std::vector<std::string>& words);
-	std::string filterWord(std::string& word);
+		       std::vector<std::string>& words, std::string& dictPath);
+	std::uint32_t internWord(const std::string& word);
+	std::uint32_t idRow(std::uint32_t id);
+	std::uint32_t itemRow(Tokenizer::Item& item);
+	void resizeArray();
+	void addRun(const std::string& path,
+		    const std::vector<std::uint32_t>& rows);
+	void loadPending();
+	void countItems(std::vector<Tokenizer::Item>& items,
+			std::uint32_t& lastCol);
+	void findReachable();
+	std::uint64_t stateFingerprint() const;
 };
 
 #endif //QUOTER_H
@@ -0,0 +1,180 @@
+#ifndef RUNFILE_H
+#define RUNFILE_H
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Sorted runs of bigram pairs spilled to disk while counting out of core.
+ *
+ * A pair packs the row of the previous item into the high 32 bits and
+ * the row of the next item into the low 32 bits. A run is a sequence of
+ * (pair, count) records in strictly increasing pair order. Each record
+ * is stored as the pair's distance from the previous pair followed by
+ * the count, both as base-128 varints, so dense runs take a couple of
+ * bytes per record.
+ */
+
+// Most bytes a base-128 varint of a 64-bit value takes.
+static const std::size_t MAX_VARINT_BYTES = 10;
+
+/* Appends a value as a base-128 varint: seven bits per byte, least
+ * significant first, with the top bit set on every byte but the last.
+ *
+ * @param buf Buffer to append to.
+ * @param v Value to append.
+ */
+void putVarint(std::string& buf, std::uint64_t v);
+
+/* Reads a base-128 varint.
+ *
+ * @param buf Buffer to read from.
+ * @param len Number of bytes in buf.
+ * @param pos Offset to read from. Advanced past the varint.
+ * @param v Set to the value read.
+ * @return False if the varint runs past len or is too long.
+ */
+bool getVarint(const char *buf, std::size_t len, std::size_t& pos,
+	       std::uint64_t& v);
+
+/* Appends a record of a run.
+ *
+ * @param buf Buffer to append to.
+ * @param last Pair of the previous record, or 0 before the first one.
+ *             Set to pair.
+ * @param pair Packed pair. Must be greater than last, unless first.
+ * @param count Number of times the pair occurred.
+ */
+void putRecord(std::string& buf, std::uint64_t& last, std::uint64_t pair,
+	       std::uint64_t count);
+
+/* Reads a record of a run.
+ *
+ * @param buf Buffer to read from.
+ * @param len Number of bytes in buf.
+ * @param pos Offset to read from. Advanced past the record.
+ * @param last Pair of the previous record, or 0 before the first one.
+ *             Set to the pair read.
+ * @param pair Set to the pair read.
+ * @param count Set to the count read.
+ * @return False if the record runs past len or is malformed.
+ */
+bool getRecord(const char *buf, std::size_t len, std::size_t& pos,
+	       std::uint64_t& last, std::uint64_t& pair, std::uint64_t& count);
+
+/* Sorts a buffer of packed pairs in place and sums duplicates.
+ *
+ * @param pairs Unsorted packed pairs.
+ * @param emit Called once per distinct pair, in ascending pair order,
+ *             with the number of times it occurs.
+ */
+void sumPairs(std::vector<std::uint64_t>& pairs,
+	      const std::function<void(std::uint64_t, std::uint64_t)>& emit);
+
+class RunWriter {
+public:
+	/* Creates a new, uniquely named run file.
+	 *
+	 * @param dir Directory to create the run file in.
+	 */
+	RunWriter(const std::string& dir);
+
+	/* Appends a record to the run.
+	 *
+	 * @param pair Packed pair. Must be greater than the previous one.
+	 * @param count Number of times the pair occurred.
+	 */
+	void write(std::uint64_t pair, std::uint64_t count);
+
+	/* Flushes and closes the run file.
+	 */
+	void close();
+
+	const std::string& path() const;
+private:
+	std::string filename;
+	std::ofstream out;
+	std::uint64_t last;
+	std::string record;
+};
+
+class RunReader {
+public:
+	/* Opens a run file for reading.
+	 *
+	 * @param path Path to the run file.
+	 * @param bufferSize Bytes to read from the file at a time. A
+	 *                   couple of records are always buffered.
+	 */
+	RunReader(const std::string& path, std::size_t bufferSize);
+
+	/* Reads the next record of the run.
+	 *
+	 * @return False once the run is exhausted.
+	 */
+	bool next(std::uint64_t& pair, std::uint64_t& count);
+private:
+	std::string filename;
+	std::ifstream in;
+	std::vector<char> buffer;
+	std::size_t pos, len;
+	std::uint64_t last;
+
+	void fill();
+};
+
+/* Owns a finished run file, which is removed along with its owner.
+ */
+class RunFile {
+public:
+	/* @param path Path to the run file.
+	 */
+	RunFile(const std::string& path);
+	~RunFile();
+	RunFile(const RunFile&) = delete;
+	RunFile& operator=(const RunFile&) = delete;
+
+	const std::string& path() const;
+
+	/* Gives up ownership of the run file without removing it.
+	 *
+	 * @return Path to the run file.
+	 */
+	std::string release();
+private:
+	std::string filename;
+};
+
+/* Writes a sorted run from a buffer of packed pairs, summing duplicates.
+ * The buffer is sorted in place.
+ *
+ * @param pairs Unsorted packed pairs.
+ * @param dir Directory to create the run file in.
+ * @return Path to the new run file.
+ */
+std::string spillRun(std::vector<std::uint64_t>& pairs, const std::string& dir);
+
+/* Merges runs into a single ascending sequence of records, summing the
+ * counts of pairs that appear in more than one run. No more than
+ * fanIn runs are open at once; larger sets are merged down through
+ * intermediate runs first. Every run passed in, and every intermediate
+ * run, is removed once it has been read or the merge fails, except for
+ * those in kept.
+ *
+ * @param runs Paths to the runs to merge.
+ * @param kept Paths of runs in runs that belong to someone else and
+ *             must not be removed.
+ * @param dir Directory for intermediate runs.
+ * @param fanIn Maximum number of runs to read from at once.
+ * @param bufferSize Read buffer size for each open run.
+ * @param emit Called once per distinct pair, in ascending pair order.
+ */
+void mergeRuns(std::vector<std::string> runs,
+	       const std::vector<std::string>& kept, const std::string& dir,
+	       std::size_t fanIn, std::size_t bufferSize,
+	       const std::function<void(std::uint64_t, std::uint64_t)>& emit);
+
+#endif //RUNFILE_H
@@ -0,0 +1,127 @@
+#ifndef SKETCHQUOTER_H
+#define SKETCHQUOTER_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "quoter.hpp"
+#include "tokenizer.hpp"
+
+/* An approximate bigram quoter for unbounded streams. Bigram frequencies
+ * are estimated with a count-min sketch instead of being counted exactly.
+ * Only the most frequent words get a row. Each row holds a bounded list
+ * of its most frequent successors. Memory use is therefore fixed no
+ * matter how much text is fed in.
+ */
+class SketchQuoter {
+public:
+	/* @param width Counters per sketch row.
+	 * @param depth Number of sketch rows. Each has its own hash.
+	 * @param maxWords Number of words that get a row.
+	 * @param maxSuccessors Number of successors kept for each row.
+	 */
+	SketchQuoter(std::size_t width = 1 << 18, std::size_t depth = 4,
+		     std::size_t maxWords = 2048,
+		     std::size_t maxSuccessors = 16);
+
+	/* Feed a stream of coherent text into quoter for it to mimic.
+	 *
+	 * @param in Stream of coherent text.
+	 */
+	void feed_stream(std::istream& in);
+
+	/* Counts parser items into the quoter as feed_stream would. See
+	 * Quoter::itemCounter.
+	 *
+	 * @return Function to call with each batch of items, in order.
+	 */
+	std::function<void(std::vector<Tokenizer::Item>&)> itemCounter();
+
+	/* Feeds a file containing coherent text into a quoter for it to mimic.
+	 *
+	 * @param filePath Path to file containing coherent text.
+	 */
+	void feed_file(std::string filePath);
+
+	/* Feed a string of coherent text into a quoter for it to mimic.
+	 *
+	 * @param text String of coherent text.
+	 */
+	void feed_string(std::string text);
+
+	/* Builds a sentence based on the text fed into a quoter.
+	 * Sentences are cut off after maxSentenceWords words.
+	 *
+	 * @return A single sentence.
+	 */
+	std::string buildSentence();
+
+	/* Builds a sentence of bounded length. A sentence that runs into
+	 * a word without retained successors is ended with a period.
+	 * Throws QuoterError if the quoter has nothing to build from.
+	 *
+	 * @param wordLimit Maximum number of words, or 0 for
+	 *                  maxSentenceWords.
+	 * @param truncate Whether to end a sentence with a period once it
+	 *                 reaches wordLimit. Otherwise QuoterError is thrown.
+	 * @return A single sentence.
+	 */
+	std::string buildSentence(std::size_t wordLimit, bool truncate);
+
+	/* Converts the retained words and successors into an exact quoter.
+	 * Each retained successor gets its estimated count.
+	 *
+	 * @return An exact quoter.
+	 */
+	Quoter toQuoter();
+
+	/* Writes the retained words and successors to a file in the
+	 * same format as Quoter::writeData.
+	 *
+	 * @param filename Name of file to write to.
+	 */
+	void writeData(std::string filename);
+
+	static const std::size_t maxSentenceWords = 1000;
+private:
+	typedef Tokenizer::Markers Markers;
+
+	struct Successor {
+		std::uint64_t key;
+		std::uint32_t count;
+	};
+
+	// A word with a row. The first entries are the sentence markers,
+	// which always keep their rows.
+	struct Entry {
+		std::uint64_t key;
+		std::string word;
+		std::uint32_t count;
+		std::vector<Successor> successors;
+	};
+
+	std::size_t width, depth, maxWords, maxSuccessors;
+	std::default_random_engine randGen;
+	std::vector<std::uint32_t> pairSketch;
+	std::vector<std::uint32_t> wordSketch;
+	std::vector<Entry> entries;
+	std::unordered_map<std::uint64_t, std::uint32_t> entryIndex;
+	// Word entry with the lowest count, if minValid is set.
+	std::size_t minEntry;
+	bool minValid;
+
+	static std::uint64_t itemKey(const Tokenizer::Item& item);
+	std::uint32_t sketchAdd(std::vector<std::uint32_t>& sketch,
+				std::uint64_t key);
+	void trackWord(std::uint64_t key, const std::string& word);
+	void trackPair(std::uint64_t prev, std::uint64_t next);
+	void countItems(std::vector<Tokenizer::Item>& items,
+			std::uint64_t& lastKey, bool& haveLast);
+	std::size_t findMinEntry();
+};
+
+#endif //SKETCHQUOTER_H
@@ -0,0 +1,104 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/* A bounded, lock-free queue between exactly one producer thread and
+ * exactly one consumer thread. Items are moved in and out of a ring of
+ * preallocated slots.
+ */
+template<typename T>
+class SpscQueue {
+public:
+	/* @param capacity Minimum number of items the queue can hold.
+	 *                 Rounded up to a power of two.
+	 */
+	SpscQueue(std::size_t capacity): head(0), tail(0) {
+		std::size_t size = 2;
+		while (size < capacity)
+			size <<= 1;
+		slots.resize(size);
+		mask = size - 1;
+	}
+
+	/* Moves an item into the queue if there is room.
+	 * Only called by the producer.
+	 *
+	 * @return False if the queue is full. item is left untouched.
+	 */
+	bool tryPush(T& item) {
+		std::size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask)
+			return false;
+		slots[t & mask] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Moves the oldest item out of the queue if there is one.
+	 * Only called by the consumer.
+	 *
+	 * @return False if the queue is empty.
+	 */
+	bool tryPop(T& item) {
+		std::size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		item = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Pushes an item, waiting for room.
+	 *
+	 * @param stop Gives up waiting once set.
+	 * @return False if stop was set before there was room.
+	 */
+	bool push(T& item, const std::atomic<bool>& stop) {
+		for (unsigned int spins = 0; !tryPush(item); spins++)
+			if (!wait(spins, stop))
+				return false;
+		return true;
+	}
+
+	/* Pops an item, waiting for one to arrive.
+	 *
+	 * @param stop Gives up waiting once set.
+	 * @return False if stop was set before an item arrived.
+	 */
+	bool pop(T& item, const std::atomic<bool>& stop) {
+		for (unsigned int spins = 0; !tryPop(item); spins++)
+			if (!wait(spins, stop))
+				return false;
+		return true;
+	}
+private:
+	std::vector<T> slots;
+	std::size_t mask;
+	// Keep the consumer's and producer's indices
+	// on separate cache lines.
+	char pad0[64];
+	std::atomic<std::size_t> head;
+	char pad1[64];
+	std::atomic<std::size_t> tail;
+	char pad2[64];
+
+	static bool wait(unsigned int spins, const std::atomic<bool>& stop) {
+		if (stop.load(std::memory_order_relaxed))
+			return false;
+		// Yield for a while, then back off to sleeping so an
+		// idle stage doesn't burn a core waiting on slow I/O.
+		if (spins < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+		return true;
+	}
+};
+
+#endif //SPSCQUEUE_H
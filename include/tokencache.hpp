@@ -0,0 +1,102 @@
+#ifndef TOKENCACHE_H
+#define TOKENCACHE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * A corpus tokenized ahead of time, so it can be fed without splitting
+ * and filtering its text again.
+ *
+ * The cache of FILE is stored next to it as FILE.bqt. It holds a fixed
+ * size header, the parser items of FILE as ids, and the cache's own
+ * dictionary. Ids below Markers::NUM_ITEMS are sentence markers.
+ * Higher ids index the dictionary, whose words are stored in order of
+ * first appearance. All fixed size fields are in the host's byte order.
+ *
+ * Ids are stored in chunks. Each chunk has a 32-bit count of its ids
+ * and a 32-bit count of its bytes, followed by the ids as base-128
+ * varints. Frequent words tend to appear early and get small ids, so
+ * most ids take a byte or two and the cache is smaller than FILE.
+ *
+ * The header records the size and modification time of FILE and the
+ * tokenizer's fingerprint. A cache is stale once either of those
+ * changes, and it is then never read.
+ */
+class TokenCache {
+public:
+	/* Opens the cache of a source file.
+	 *
+	 * @param source Path to the file the cache was built from.
+	 */
+	TokenCache(const std::string& source);
+
+	/* Reads the next run of item ids. Runs are consecutive, so the
+	 * first id of a run follows the last id of the previous one.
+	 *
+	 * @param ids Replaced by the ids read.
+	 * @return False once all ids have been read.
+	 */
+	bool read(std::vector<std::uint32_t>& ids);
+
+	/* @return Words of the cache's dictionary, indexed by id. The
+	 *         marker ids have empty words.
+	 */
+	const std::vector<std::string>& words() const;
+
+	/* Tokenizes a source file into its cache.
+	 *
+	 * @param source Path to the file to tokenize.
+	 */
+	static void build(const std::string& source);
+
+	/* @param source Path to a source file.
+	 * @return Whether source has a cache and it is up to date.
+	 */
+	static bool isFresh(const std::string& source);
+
+	/* @param source Path to a source file.
+	 * @return Path of the source file's cache.
+	 */
+	static std::string cachePath(const std::string& source);
+
+	/* What anything derived from tokenizing a source file depends on.
+	 * It goes stale once the stamp of its source changes.
+	 */
+	struct SourceStamp {
+		std::uint64_t fingerprint;
+		std::uint64_t size;
+		std::int64_t mtimeSec;
+		std::int64_t mtimeNsec;
+	};
+
+	/* @param source Path to a source file.
+	 * @return The source file's size and modification time, and the
+	 *         tokenizer's fingerprint.
+	 */
+	static SourceStamp sourceStamp(const std::string& source);
+private:
+	struct Header {
+		char magic[4];
+		std::uint32_t version;
+		SourceStamp source;
+		std::uint64_t tokenCount;
+		std::uint64_t dictOffset;
+		std::uint32_t wordCount;
+		std::uint32_t reserved;
+	};
+
+	std::string filename;
+	std::ifstream in;
+	std::vector<std::string> dictionary;
+	std::uint64_t remaining;
+	std::string chunk;
+
+	static Header sourceHeader(const std::string& source);
+	static bool readHeader(std::ifstream& cache, Header& header);
+	static bool matches(const Header& a, const Header& b);
+};
+
+#endif //TOKENCACHE_H
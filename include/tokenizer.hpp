@@ -0,0 +1,110 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Turns whitespace-delimited words into a stream of parser items:
+ * filtered words surrounded by sentence markers. Every complete item
+ * stream starts with a START marker and ends with an end marker.
+ */
+class Tokenizer {
+public:
+	enum struct Markers: std::uint32_t {
+		START,
+		PERIOD,
+		EXCLAIM,
+		QUESTION,
+		NUM_ITEMS
+	};
+
+	enum struct ItemTypes: std::uint32_t {
+		MARKER,
+		WORD
+	};
+
+	struct Item {
+		ItemTypes type;
+		Markers marker;
+		std::string word;
+	};
+
+	/* A raw word after filtering. end is the marker the word ends
+	 * a sentence with, or NUM_ITEMS if it doesn't end one.
+	 */
+	struct Word {
+		std::string text;
+		Markers end;
+	};
+
+	/* Sentence state between two words. Restoring it lets another
+	 * tokenizer carry on with a stream where this one left off.
+	 */
+	struct State {
+		bool start_of_sentence;
+		bool start_pending;
+		bool last_was_word;
+	};
+
+	Tokenizer();
+
+	/* Filters a raw word and checks whether it ends a sentence.
+	 * This doesn't depend on any sentence state, so words may be
+	 * scanned ahead of time or on another thread.
+	 *
+	 * @param raw Whitespace-delimited word.
+	 * @return The scanned word.
+	 */
+	static Word scan(const std::string& raw);
+
+	/* Pushes a scanned word through the sentence state.
+	 *
+	 * @param word Scanned word. Its text is moved from.
+	 * @param items Parser items produced by the word are appended here.
+	 */
+	void push(Word& word, std::vector<Item>& items);
+
+	/* Ends the item stream, closing or dropping an unfinished
+	 * sentence. The tokenizer is ready for a new stream afterwards.
+	 *
+	 * @param items Parser items produced are appended here.
+	 */
+	void finish(std::vector<Item>& items);
+
+	/* Removes unwanted characters from a word.
+	 *
+	 * @param word Word to filter.
+	 * @return The filtered word. May be empty.
+	 */
+	static std::string filterWord(const std::string& word);
+
+	/* @return The current sentence state.
+	 */
+	State state() const;
+
+	/* Continues from a sentence state saved earlier.
+	 *
+	 * @param s State returned by state().
+	 */
+	void restore(const State& s);
+
+	/* Hashes how the tokenizer treats every single character and a
+	 * set of sample sentences. Changes to the filtering or sentence
+	 * rules change the fingerprint.
+	 *
+	 * @return Fingerprint of the tokenizer's behaviour.
+	 */
+	static std::uint64_t fingerprint();
+private:
+	bool start_of_sentence;
+	// A START marker is owed but has not been emitted yet,
+	// since the sentence might turn out to be empty.
+	bool start_pending;
+	bool last_was_word;
+
+	static bool keepChar(char c);
+	static Item marker(Markers m);
+};
+
+#endif //TOKENIZER_H
@@ -1,18 +1,24 @@
 /*
  * TODO
- *  - Check if bigram quoter has been fed before building a sentence.
  *  - Enforce a file extension (maybe .bq). If the file extension is not
  *    included with a savefile string, it will be appended automatically.
  *  - Add command for manually saving stashed bigram quoters.
  *    Don't save them automatically.
- *  - Finish merge command.
  */
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <exception>
+#include <functional>
+#include <iomanip>
 #include <vector>
 #include <unistd.h>
 #include "argparser.hpp"
+#include "pipeline.hpp"
+#include "tokencache.hpp"
 
 /*
  * Define a temporary macro to mark passed arguments as unused.
@@ -20,18 +26,27 @@
  */
 #define UNUSED(x) ((void)(x))
 
-const char *opts_string = "stn:o:l:m:f:b";
+const char *opts_string = "stn:o:l:m:f:be:T:a:k:j:d:w:p:c:";
 
-void ArgParser::parseArgs(int argc, char **argv) {
+int ArgParser::parseArgs(int argc, char **argv) {
 	if (argc == 1) {
 		std::cerr << argv[0] << ": no arguments given\n" << std::endl;
 		#include "showhelp.h"
 		std::cerr <<
 			"\nSee https://github.com/JoshuaBrockschmidt/bigram_quoter"
 			"\n" << std::endl;
-	        exit(1);
+	        return 1;
 	}
 	std::vector<std::pair<Quoter, std::string>> stash;
+	std::vector<std::pair<SketchQuoter, std::string>> sketchStash;
+	std::shared_ptr<Dictionary> sharedDict;
+	std::size_t maxWords = 0;
+	FeedSettings feedSettings;
+	feedSettings.externalBudget = 0;
+	feedSettings.tokenizers = 0;
+	feedSettings.checkpointInterval = 0;
+	const char *tmpdir = getenv("TMPDIR");
+	feedSettings.tempDir = tmpdir && *tmpdir ? tmpdir : "/tmp";
 	bool strictMode = false, strictMode_exit = false;
 	int o, argi = 1;
 	while ((o = getopt_long(argc, argv, opts_string, opts_long, &argi)) != -1) {
@@ -47,62 +62,148 @@ void ArgParser::parseArgs(int argc, char **argv) {
 		case 'n':
 			// Create and save a new bigram quoter
 			// and add it to the queue.
-			option_new(argc, argv, stash,
+			option_new(argc, argv, stash, sketchStash, sharedDict,
 				   strictMode, strictMode_exit);
 			break;
 		case 'o':
 			// Create a new bigram quoter with the same as an
 			// existing bigram quoter.
-			option_overwrite(argc, argv, stash,
+			option_overwrite(argc, argv, stash, sketchStash, sharedDict,
 					 strictMode, strictMode_exit);
 			break;
 		case 'l':
 			// Load a bigram quoter and add it to the queue.
-			option_load(argc, argv, stash,
+			option_load(argc, argv, stash, sketchStash,
 				    strictMode, strictMode_exit);
 			break;
 		case 'm':
 			// Merge bigram quoters in queue into one or more
 			// new quoter and add them to the queue.
-			option_merge(argc, argv, stash,
+			option_merge(argc, argv, stash, sketchStash, sharedDict,
 				     strictMode, strictMode_exit);
 			break;
 		case 'f':
 			// Feed one or more text file into
 			// the queued bigram quoters.
-			option_feed(argc, argv, stash,
+			option_feed(argc, argv, stash, sketchStash, feedSettings,
 				    strictMode, strictMode_exit);
 			break;
 		case 'b':
 			// Construct/build one sentence for each
 			// queued bigram quoter.
-			option_build(argc, argv, stash,
+			option_build(argc, argv, stash, sketchStash, maxWords,
 				     strictMode, strictMode_exit);
 			break;
+		case 'w':
+			// Limit the length of built sentences.
+			option_maxWords(argc, argv, maxWords,
+					strictMode, strictMode_exit);
+			break;
+		case 'p':
+			// Measure how long building sentences takes
+			// for each queued bigram quoter.
+			option_profile(argc, argv, stash, sketchStash, maxWords,
+				       strictMode, strictMode_exit);
+			break;
+		case 'a':
+			// Create and save a new approximate bigram
+			// quoter and add it to the stash.
+			option_approximate(argc, argv, stash, sketchStash,
+					   strictMode, strictMode_exit);
+			break;
+		case 'k':
+			// Tokenize a text file into a cache
+			// for later feeds to read from.
+			option_tokenize(argc, argv,
+					strictMode, strictMode_exit);
+			break;
+		case 'd':
+			// Share a dictionary between proceeding
+			// new bigram quoters.
+			option_dictionary(argc, argv, sharedDict,
+					  strictMode, strictMode_exit);
+			break;
+		case 'e':
+			// Feed files out of core from now on.
+			option_external(argc, argv, feedSettings,
+					strictMode, strictMode_exit);
+			break;
+		case 'j':
+			// Pipeline feeds from now on.
+			option_jobs(argc, argv, feedSettings,
+				    strictMode, strictMode_exit);
+			break;
+		case 'T':
+			// Set where out-of-core feeds spill to.
+			option_tempdir(argc, argv, feedSettings,
+				       strictMode, strictMode_exit);
+			break;
+		case 'c':
+			// Checkpoint feeds from now on.
+			option_checkpoint(argc, argv, feedSettings,
+					  strictMode, strictMode_exit);
+			break;
 		default:
 			break;
 		}
 
+		// Return rather than exit, so the stash is destroyed and
+		// out-of-core counts don't outlive the process in tempDir.
 		if (strictMode_exit) {
 			std::cerr << argv[0]
 				  << ": exiting as per strict mode"
 				  << std::endl;
-			exit(EXIT_FAILURE);
+			return EXIT_FAILURE;
 		}
 	}
 
 	// Write stashed bigram quoters to their respective save files.
+	int status = EXIT_SUCCESS;
 	std::vector<std::pair<Quoter, std::string>>::iterator s_it;
-        for (s_it = stash.begin(); s_it != stash.end(); ++s_it)
-		s_it->first.writeData(s_it->second);
+        for (s_it = stash.begin(); s_it != stash.end(); ++s_it) {
+		try {
+			s_it->first.writeData(s_it->second);
+		} catch (QuoterError& e) {
+			std::cerr << argv[0]
+				  << ": cannot save '"
+				  << s_it->second
+				  << "': "
+				  << e.what()
+				  << std::endl;
+			status = EXIT_FAILURE;
+			continue;
+		}
+		// Checkpoints of feeds are only needed until they're saved.
+		unsigned int feeds = feedSettings.checkpoints[s_it->second];
+		for (unsigned int k = 0; k < feeds; k++)
+			std::remove(journalPath(s_it->second, k).c_str());
+	}
+	std::vector<std::pair<SketchQuoter, std::string>>::iterator k_it;
+	for (k_it = sketchStash.begin(); k_it != sketchStash.end(); ++k_it) {
+		try {
+			k_it->first.writeData(k_it->second);
+		} catch (QuoterError& e) {
+			std::cerr << argv[0]
+				  << ": cannot save '"
+				  << k_it->second
+				  << "': "
+				  << e.what()
+				  << std::endl;
+			status = EXIT_FAILURE;
+		}
+	}
+	return status;
 }
 
 void ArgParser::option_new(int argc, char **argv,
 			   std::vector<std::pair<Quoter, std::string>>& stash,
+			   std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			   const std::shared_ptr<Dictionary>& sharedDict,
 			   bool strictMode, bool& strictMode_exit) {
 	UNUSED(argc);
 	std::string filename(optarg);
-	if (access(optarg, F_OK) != -1 || filenameInStash(stash, filename)) {
+	if (access(optarg, F_OK) != -1 || filenameInStash(stash, filename) ||
+	    filenameInStash(sketchStash, filename)) {
 		std::cerr << argv[0]
 			  << ": cannot create '"
 			  << filename
@@ -112,16 +213,20 @@ void ArgParser::option_new(int argc, char **argv,
 			strictMode_exit = true;
 		return;
 	}
-	std::pair<Quoter, std::string> newPair(Quoter(), filename);
+	std::pair<Quoter, std::string> newPair(
+		sharedDict ? Quoter(sharedDict) : Quoter(), filename);
 	stash.push_back(newPair);
 }
 
 void ArgParser::option_overwrite(int argc, char **argv,
 				 std::vector<std::pair<Quoter, std::string>>& stash,
+				 std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+				 const std::shared_ptr<Dictionary>& sharedDict,
 				 bool strictMode, bool& strictMode_exit) {
 	UNUSED(argc);
 	std::string filename(optarg);
-	if (access(optarg, F_OK) == -1 || filenameInStash(stash, filename)) {
+	if (access(optarg, F_OK) == -1 || filenameInStash(stash, filename) ||
+	    filenameInStash(sketchStash, filename)) {
 		std::cerr << argv[0]
 			  << ": cannot overwrite '"
 			  << filename
@@ -131,16 +236,19 @@ void ArgParser::option_overwrite(int argc, char **argv,
 			strictMode_exit = true;
 		return;
 	}
-	std::pair<Quoter, std::string> newPair(Quoter(), filename);
+	std::pair<Quoter, std::string> newPair(
+		sharedDict ? Quoter(sharedDict) : Quoter(), filename);
 	stash.push_back(newPair);
 }
 
 void ArgParser::option_load(int argc, char **argv,
 			    std::vector<std::pair<Quoter, std::string>>& stash,
+			    std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
 			    bool strictMode, bool& strictMode_exit) {
 	UNUSED(argc);
 	std::string filename(optarg);
-	if (filenameInStash(stash, filename)) {
+	if (filenameInStash(stash, filename) ||
+	    filenameInStash(sketchStash, filename)) {
 		std::cerr << argv[0]
 			  << ": cannot load '"
 			  << filename
@@ -177,10 +285,13 @@ void ArgParser::option_load(int argc, char **argv,
 
 void ArgParser::option_merge(int argc, char **argv,
 			     std::vector<std::pair<Quoter, std::string>>& stash,
+			     std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			     const std::shared_ptr<Dictionary>& sharedDict,
 			     bool strictMode, bool& strictMode_exit) {
 	UNUSED(argc);
 	std::string filename(optarg);
-	if (access(optarg, F_OK) != -1 || filenameInStash(stash, filename)) {
+	if (access(optarg, F_OK) != -1 || filenameInStash(stash, filename) ||
+	    filenameInStash(sketchStash, filename)) {
 		std::cerr << argv[0]
 			  << ": cannot create '"
 			  << filename
@@ -190,16 +301,40 @@ void ArgParser::option_merge(int argc, char **argv,
 			strictMode_exit = true;
 		return;
 	}
-	//TODO
-	return;
+
+	// Merge into the shared dictionary if there is one in use.
+	// Otherwise keep sharing a dictionary all stashed quoters share.
+	std::shared_ptr<Dictionary> dict = sharedDict;
+	if (!dict && !stash.empty() &&
+	    !stash.front().first.getDictionary()->path().empty()) {
+		dict = stash.front().first.getDictionary();
+		std::vector<std::pair<Quoter, std::string>>::iterator s_it;
+		for (s_it = stash.begin(); s_it != stash.end(); ++s_it)
+			if (s_it->first.getDictionary() != dict)
+				dict.reset();
+	}
+	Quoter merged = dict ? Quoter(dict) : Quoter();
+
+	std::vector<std::pair<Quoter, std::string>>::iterator s_it;
+	for (s_it = stash.begin(); s_it != stash.end(); ++s_it)
+		merged.merge(s_it->first);
+	std::vector<std::pair<SketchQuoter, std::string>>::iterator k_it;
+	for (k_it = sketchStash.begin(); k_it != sketchStash.end(); ++k_it)
+		merged.merge(k_it->first.toQuoter());
+
+	stash.push_back(std::make_pair(merged, filename));
 }
 
 void ArgParser::option_feed(int argc, char **argv,
 			    std::vector<std::pair<Quoter, std::string>>& stash,
+			    std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			    FeedSettings& feedSettings,
 			    bool strictMode, bool& strictMode_exit) {
 	UNUSED(argc);
 	std::string filename(optarg);
-	if (access(optarg, F_OK) == -1) {
+	// Feed standard input if the filename is "-".
+	bool useStdin = filename == "-";
+	if (!useStdin && access(optarg, F_OK) == -1) {
 		std::cerr << argv[0]
 			  << ": cannot feed '"
 			  << filename
@@ -209,25 +344,139 @@ void ArgParser::option_feed(int argc, char **argv,
 			strictMode_exit = true;
 		return;
 	}
+	bool useCache = false;
+	if (!useStdin && !stash.empty() &&
+	    access(TokenCache::cachePath(filename).c_str(), F_OK) != -1) {
+		useCache = TokenCache::isFresh(filename);
+		if (!useCache)
+			std::cerr << argv[0]
+				  << ": ignoring token cache of '"
+				  << filename
+				  << "'; it is out of date"
+				  << std::endl;
+	}
 	std::vector<std::pair<Quoter, std::string>>::iterator s_it;
-	for (s_it = stash.begin(); s_it != stash.end(); ++s_it) {
+	std::vector<std::pair<SketchQuoter, std::string>>::iterator k_it;
+	bool pipelined = useStdin ||
+		(!useCache && !feedSettings.externalBudget &&
+		 !feedSettings.checkpointInterval && feedSettings.tokenizers);
+	if (pipelined) {
+		// Standard input can only be read once, so it is always
+		// pipelined into all stashed quoters together, approximate
+		// ones included.
+		std::vector<std::function<void(std::vector<Tokenizer::Item>&)>> counters;
+		for (s_it = stash.begin(); s_it != stash.end(); ++s_it)
+			counters.push_back(s_it->first.itemCounter());
+		for (k_it = sketchStash.begin(); k_it != sketchStash.end(); ++k_it)
+			counters.push_back(k_it->first.itemCounter());
 		try {
-			s_it->first.feed_file(filename);
+			if (useStdin) {
+				Pipeline::feed(std::cin, feedSettings.tokenizers,
+					       counters);
+			} else {
+				std::ifstream ifs(filename);
+				if (!ifs.is_open())
+					throw QuoterError("Could not open " +
+							  filename);
+				Pipeline::feed(ifs, feedSettings.tokenizers,
+					       counters);
+			}
+		} catch (QuoterError& e) {
+			std::cerr << argv[0]
+				  << ": cannot feed '"
+				  << filename
+				  << "' to bigram quoters: "
+				  << e.what()
+				  << std::endl;
+		}
+	} else {
+		std::vector<std::string> unsaved;
+		for (s_it = stash.begin(); s_it != stash.end(); ++s_it) {
+			std::string journal;
+			try {
+				if (useCache)
+					s_it->first.feed_cache(filename);
+				else if (feedSettings.externalBudget)
+					s_it->first.feed_file_external(
+						filename, feedSettings.tempDir,
+						feedSettings.externalBudget);
+				else if (feedSettings.checkpointInterval) {
+					// Feeds are numbered per quoter, so rerunning
+					// the same command finds their journals again.
+					unsigned int k =
+						feedSettings.checkpoints[s_it->second]++;
+					journal = journalPath(s_it->second, k);
+					std::uint64_t resumed =
+						s_it->first.feed_file_checkpointed(
+							filename, journal,
+							feedSettings.checkpointInterval);
+					if (resumed)
+						std::cerr << argv[0]
+							  << ": resumed feeding '"
+							  << filename
+							  << "' to '"
+							  << s_it->second
+							  << "' at byte "
+							  << resumed
+							  << std::endl;
+				} else
+					s_it->first.feed_file(filename);
+			} catch (QuoterError& e) {
+				std::cerr << argv[0]
+					  << ": cannot feed to '"
+					  << s_it->second
+					  << "': "
+					  << e.what()
+					  << std::endl;
+				if (journal.empty())
+					continue;
+				// Part of the file may be counted by now. Saving
+				// that would make it final and remove the journal,
+				// so treat the quoter as if the process had died.
+				std::cerr << argv[0]
+					  << ": not saving '"
+					  << s_it->second
+					  << "'; rerun to resume from '"
+					  << journal
+					  << "', or remove it to start over"
+					  << std::endl;
+				unsaved.push_back(s_it->second);
+			}
+		}
+		if (!unsaved.empty()) {
+			std::vector<std::pair<Quoter, std::string>> rest;
+			rest.reserve(stash.size());
+			for (s_it = stash.begin(); s_it != stash.end(); ++s_it)
+				if (std::find(unsaved.begin(), unsaved.end(),
+					      s_it->second) == unsaved.end())
+					rest.push_back(std::move(*s_it));
+			stash.swap(rest);
+		}
+	}
+	if (pipelined)
+		return;
+	// Otherwise approximate quoters read the file as a stream of their own.
+	for (k_it = sketchStash.begin(); k_it != sketchStash.end(); ++k_it) {
+		try {
+			k_it->first.feed_file(filename);
 		} catch (QuoterError& e) {
 			std::cerr << argv[0]
 				  << ": cannot feed to '"
-				  << s_it->second
+				  << k_it->second
 				  << "': "
-				  << e.what();
+				  << e.what()
+				  << std::endl;
 		}
 	}
 }
 
 void ArgParser::option_build(int argc, char **argv,
 			     std::vector<std::pair<Quoter, std::string>>& stash,
+			     std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			     std::size_t maxWords,
 			     bool strictMode, bool& strictMode_exit) {
 	UNUSED(argc);
-	if (stash.empty()) {
+	if (stash.empty() && sketchStash.empty()) {
 		std::cerr << argv[0]
 			  << ": cannot build sentences; stash is empty"
 			  << std::endl;
@@ -235,9 +484,313 @@ void ArgParser::option_build(int argc, char **argv,
 			strictMode_exit = true;
 		return;
 	}
+	// Sentences over the limit are cut off,
+	// unless that is an error in strict mode.
 	std::vector<std::pair<Quoter, std::string>>::iterator s_it;
-	for (s_it = stash.begin(); s_it != stash.end(); ++s_it)
-		std::cout << s_it->first.buildSentence() << std::endl;
+	for (s_it = stash.begin(); s_it != stash.end(); ++s_it) {
+		try {
+			std::cout << s_it->first.buildSentence(maxWords,
+							       !strictMode)
+				  << std::endl;
+		} catch (QuoterError& e) {
+			std::cerr << argv[0]
+				  << ": cannot build from '"
+				  << s_it->second
+				  << "': "
+				  << e.what()
+				  << std::endl;
+			if (strictMode)
+				strictMode_exit = true;
+		}
+	}
+	std::vector<std::pair<SketchQuoter, std::string>>::iterator k_it;
+	for (k_it = sketchStash.begin(); k_it != sketchStash.end(); ++k_it) {
+		try {
+			std::cout << k_it->first.buildSentence(maxWords,
+							       !strictMode)
+				  << std::endl;
+		} catch (QuoterError& e) {
+			std::cerr << argv[0]
+				  << ": cannot build from '"
+				  << k_it->second
+				  << "': "
+				  << e.what()
+				  << std::endl;
+			if (strictMode)
+				strictMode_exit = true;
+		}
+	}
+}
+
+void ArgParser::option_profile(int argc, char **argv,
+			       std::vector<std::pair<Quoter, std::string>>& stash,
+			       std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+			       std::size_t maxWords,
+			       bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::size_t count;
+	if (!parseSize(optarg, count) || count == 0) {
+		std::cerr << argv[0]
+			  << ": invalid number of sentences '"
+			  << optarg
+			  << "'"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+
+	std::vector<std::pair<std::function<std::string()>, std::string>> builders;
+	std::vector<std::pair<Quoter, std::string>>::iterator s_it;
+	for (s_it = stash.begin(); s_it != stash.end(); ++s_it) {
+		Quoter *q = &s_it->first;
+		builders.push_back(std::make_pair(
+			[q, maxWords]() { return q->buildSentence(maxWords, true); },
+			s_it->second));
+	}
+	std::vector<std::pair<SketchQuoter, std::string>>::iterator k_it;
+	for (k_it = sketchStash.begin(); k_it != sketchStash.end(); ++k_it) {
+		SketchQuoter *q = &k_it->first;
+		builders.push_back(std::make_pair(
+			[q, maxWords]() { return q->buildSentence(maxWords, true); },
+			k_it->second));
+	}
+
+	std::vector<double> latencies(count);
+	std::vector<std::pair<std::function<std::string()>, std::string>>::iterator b_it;
+	for (b_it = builders.begin(); b_it != builders.end(); ++b_it) {
+		try {
+			// Leave out one-off setup, such as finding
+			// which words can end a sentence.
+			b_it->first();
+			for (std::size_t i = 0; i < count; i++) {
+				std::chrono::steady_clock::time_point start =
+					std::chrono::steady_clock::now();
+				b_it->first();
+				latencies[i] = std::chrono::duration<double, std::micro>(
+					std::chrono::steady_clock::now() - start).count();
+			}
+		} catch (QuoterError& e) {
+			std::cerr << argv[0]
+				  << ": cannot profile '"
+				  << b_it->second
+				  << "': "
+				  << e.what()
+				  << std::endl;
+			if (strictMode)
+				strictMode_exit = true;
+			continue;
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+		std::cout << b_it->second
+			  << ": " << count << " sentences"
+			  << std::fixed << std::setprecision(1)
+			  << ", p50 " << latencies[(count - 1) * 50 / 100] << "us"
+			  << ", p99 " << latencies[(count - 1) * 99 / 100] << "us"
+			  << ", max " << latencies[count - 1] << "us"
+			  << std::defaultfloat
+			  << std::endl;
+	}
+}
+
+void ArgParser::option_approximate(int argc, char **argv,
+				   std::vector<std::pair<Quoter, std::string>>& stash,
+				   std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+				   bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::string filename(optarg);
+	if (access(optarg, F_OK) != -1 || filenameInStash(stash, filename) ||
+	    filenameInStash(sketchStash, filename)) {
+		std::cerr << argv[0]
+			  << ": cannot create '"
+			  << filename
+			  << "'; it already exists"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+	sketchStash.push_back(std::make_pair(SketchQuoter(), filename));
+}
+
+void ArgParser::option_tokenize(int argc, char **argv,
+				bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::string filename(optarg);
+	if (access(optarg, F_OK) == -1) {
+		std::cerr << argv[0]
+			  << ": cannot tokenize '"
+			  << filename
+			  << "'; it doesn't exist"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+	if (TokenCache::isFresh(filename))
+		return;
+	try {
+		TokenCache::build(filename);
+	} catch (QuoterError& e) {
+		std::cerr << argv[0]
+			  << ": cannot tokenize '"
+			  << filename
+			  << "': "
+			  << e.what()
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+	}
+}
+
+void ArgParser::option_dictionary(int argc, char **argv,
+				  std::shared_ptr<Dictionary>& sharedDict,
+				  bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::string filename(optarg);
+	// Stop sharing if the filename is "-".
+	if (filename == "-") {
+		sharedDict.reset();
+		return;
+	}
+	try {
+		sharedDict = Dictionary::open(filename);
+	} catch (QuoterError& e) {
+		std::cerr << argv[0]
+			  << ": cannot load dictionary: "
+			  << e.what()
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+	}
+}
+
+void ArgParser::option_external(int argc, char **argv,
+				FeedSettings& feedSettings,
+				bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::size_t budget;
+	if (!parseSize(optarg, budget)) {
+		std::cerr << argv[0]
+			  << ": invalid memory budget '"
+			  << optarg
+			  << "'"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+	feedSettings.externalBudget = budget;
+}
+
+void ArgParser::option_jobs(int argc, char **argv,
+			    FeedSettings& feedSettings,
+			    bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	char *end;
+	errno = 0;
+	unsigned long n = strtoul(optarg, &end, 10);
+	if (end == optarg || *end != '\0' || errno == ERANGE ||
+	    *optarg == '-' || n > 256) {
+		std::cerr << argv[0]
+			  << ": invalid number of jobs '"
+			  << optarg
+			  << "'"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+	feedSettings.tokenizers = n;
+}
+
+void ArgParser::option_maxWords(int argc, char **argv, std::size_t& maxWords,
+				bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::size_t n;
+	if (!parseSize(optarg, n)) {
+		std::cerr << argv[0]
+			  << ": invalid number of words '"
+			  << optarg
+			  << "'"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+	maxWords = n;
+}
+
+void ArgParser::option_tempdir(int argc, char **argv,
+			       FeedSettings& feedSettings,
+			       bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::string dirname(optarg);
+	if (access(optarg, W_OK) == -1) {
+		std::cerr << argv[0]
+			  << ": cannot spill to '"
+			  << dirname
+			  << "'; it isn't a writable directory"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+	feedSettings.tempDir = dirname;
+}
+
+void ArgParser::option_checkpoint(int argc, char **argv,
+				  FeedSettings& feedSettings,
+				  bool strictMode, bool& strictMode_exit) {
+	UNUSED(argc);
+	std::size_t interval;
+	if (!parseSize(optarg, interval)) {
+		std::cerr << argv[0]
+			  << ": invalid checkpoint interval '"
+			  << optarg
+			  << "'"
+			  << std::endl;
+		if (strictMode)
+			strictMode_exit = true;
+		return;
+	}
+	feedSettings.checkpointInterval = interval;
+}
+
+bool ArgParser::parseSize(const char *str, std::size_t& size) {
+	char *end;
+	errno = 0;
+	unsigned long long n = strtoull(str, &end, 10);
+	if (end == str || errno == ERANGE || *str == '-')
+		return false;
+
+	switch (*end) {
+	case '\0':
+		break;
+	case 'G': case 'g':
+		n <<= 10;
+		// Fall through.
+	case 'M': case 'm':
+		n <<= 10;
+		// Fall through.
+	case 'K': case 'k':
+		n <<= 10;
+		end++;
+		break;
+	default:
+		return false;
+	}
+	if (*end != '\0')
+		return false;
+
+	size = n;
+	return true;
+}
+
+std::string ArgParser::journalPath(const std::string& saveFile,
+				   unsigned int feed) {
+	return saveFile + "." + std::to_string(feed) + ".ckpt";
 }
 
 bool ArgParser::filenameInStash(std::vector<std::pair<Quoter, std::string>>& stash,
@@ -248,3 +801,12 @@ bool ArgParser::filenameInStash(std::vector<std::pair<Quoter, std::string>>& sta
 			return true;
 	return false;
 }
+
+bool ArgParser::filenameInStash(std::vector<std::pair<SketchQuoter, std::string>>& sketchStash,
+				const std::string& filename) {
+	std::vector<std::pair<SketchQuoter, std::string>>::iterator k_it;
+	for (k_it = sketchStash.begin(); k_it != sketchStash.end(); ++k_it)
+		if (k_it->second == filename)
+			return true;
+	return false;
+}
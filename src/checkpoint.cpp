@@ -0,0 +1,251 @@
+#include <cstring>
+#include <unistd.h>
+#include "checkpoint.hpp"
+#include "hash.hpp"
+#include "quoter.hpp"
+#include "runfile.hpp"
+
+static const char JOURNAL_MAGIC[4] = {'B', 'Q', 'C', 'K'};
+static const std::uint32_t JOURNAL_VERSION = 2;
+
+// Deltas the feed may get ahead of the background thread by.
+static const std::size_t QUEUE_DEPTH = 2;
+
+// Bits of the flags byte of a delta.
+static const unsigned char FLAG_START_OF_SENTENCE = 1 << 0;
+static const unsigned char FLAG_START_PENDING = 1 << 1;
+static const unsigned char FLAG_LAST_WAS_WORD = 1 << 2;
+static const unsigned char FLAG_FINISHED = 1 << 3;
+
+Checkpoint::Checkpoint(const std::string& path, const std::string& source,
+		       std::uint64_t base):
+	filename(path),
+	header(sourceHeader(source, base)),
+	validEnd(0),
+	journalSize(0),
+	out(NULL),
+	stop(false),
+	failed(false),
+	done(false) {
+	in.open(filename, std::ios::binary);
+	if (!in.is_open())
+		return;
+
+	Header old;
+	in.read((char *)&old, sizeof(old));
+	if (in.gcount() != sizeof(old) ||
+	    std::memcmp(&old, &header, sizeof(old)) != 0) {
+		in.close();
+		return;
+	}
+	validEnd = sizeof(old);
+	in.seekg(0, std::ios::end);
+	journalSize = in.tellg();
+	in.seekg(validEnd);
+}
+
+Checkpoint::~Checkpoint() {
+	stop = true;
+	if (writer.joinable())
+		writer.join();
+	if (out)
+		std::fclose(out);
+}
+
+bool Checkpoint::resume(Delta& delta) {
+	if (!in.is_open())
+		return false;
+
+	// Anything short of a complete delta with a matching checksum
+	// ends the journal.
+	std::uint64_t len, sum;
+	std::string payload;
+	bool complete = false;
+	in.read((char *)&len, sizeof(len));
+	if (in.gcount() == sizeof(len) &&
+	    len + 2 * sizeof(len) <= journalSize - validEnd) {
+		payload.resize(len);
+		in.read(&payload[0], len);
+		in.read((char *)&sum, sizeof(sum));
+		complete = in && fnv1a(payload) == sum;
+	}
+	if (!complete) {
+		in.close();
+		return false;
+	}
+
+	const char *buf = payload.data();
+	std::size_t pos = 0;
+	std::uint64_t v, count, pair, last = 0;
+	unsigned char flags;
+	bool ok = getVarint(buf, len, pos, delta.offset) && pos < len;
+	if (ok) {
+		flags = payload[pos++];
+		delta.state.start_of_sentence = flags & FLAG_START_OF_SENTENCE;
+		delta.state.start_pending = flags & FLAG_START_PENDING;
+		delta.state.last_was_word = flags & FLAG_LAST_WAS_WORD;
+		delta.finished = flags & FLAG_FINISHED;
+		ok = getVarint(buf, len, pos, v) && v <= UINT32_MAX;
+		delta.lastCol = v;
+	}
+	if (ok) {
+		ok = getVarint(buf, len, pos, v) && v <= UINT32_MAX;
+		delta.firstId = v;
+	}
+	delta.words.clear();
+	if (ok && (ok = getVarint(buf, len, pos, count)))
+		for (std::uint64_t i = 0; ok && i < count; i++) {
+			ok = getVarint(buf, len, pos, v) && v <= len - pos;
+			if (ok) {
+				delta.words.push_back(payload.substr(pos, v));
+				pos += v;
+			}
+		}
+	delta.pairs.clear();
+	delta.counts.clear();
+	if (ok && (ok = getVarint(buf, len, pos, count)))
+		for (std::uint64_t i = 0; ok && i < count; i++) {
+			ok = getRecord(buf, len, pos, last, pair, v);
+			delta.pairs.push_back(pair);
+			delta.counts.push_back(v);
+		}
+	if (!ok || pos != len) {
+		std::string m = "Error in Checkpoint: Journal '";
+		m += filename;
+		m += "' is corrupt: Bad delta";
+		throw QuoterError(m);
+	}
+
+	validEnd += sizeof(len) + len + sizeof(sum);
+	return true;
+}
+
+void Checkpoint::write(Delta& delta) {
+	if (!out)
+		open();
+	if (failed) {
+		std::string m = "Error in Checkpoint: Failed writing '";
+		m += filename;
+		m += "'";
+		throw QuoterError(m);
+	}
+	done = delta.finished;
+	queue->push(delta, stop);
+}
+
+void Checkpoint::close() {
+	// The background thread stops by itself after the finished delta.
+	if (!done)
+		stop = true;
+	if (writer.joinable())
+		writer.join();
+	if (out) {
+		std::fclose(out);
+		out = NULL;
+	}
+	if (failed) {
+		std::string m = "Error in Checkpoint: Failed writing '";
+		m += filename;
+		m += "'";
+		throw QuoterError(m);
+	}
+}
+
+void Checkpoint::open() {
+	// Continue after the deltas that were resumed from, dropping any
+	// incomplete or unread ones. Otherwise start a new journal.
+	bool resumed = validEnd != 0;
+	in.close();
+	if (resumed && truncate(filename.c_str(), validEnd) == 0)
+		out = std::fopen(filename.c_str(), "ab");
+	else if (!resumed)
+		out = std::fopen(filename.c_str(), "wb");
+	if (!out) {
+		std::string m = "Error in Checkpoint: Cannot open file '";
+		m += filename;
+		m += "' for writing";
+		throw QuoterError(m);
+	}
+	if (!resumed &&
+	    (std::fwrite(&header, sizeof(header), 1, out) != 1 ||
+	     std::fflush(out) != 0 || fsync(fileno(out)) != 0)) {
+		std::string m = "Error in Checkpoint: Failed writing '";
+		m += filename;
+		m += "'";
+		throw QuoterError(m);
+	}
+
+	queue.reset(new SpscQueue<Delta>(QUEUE_DEPTH));
+	writer = std::thread(&Checkpoint::writeLoop, this);
+}
+
+void Checkpoint::writeLoop() {
+	Delta delta;
+	while (queue->pop(delta, stop)) {
+		// After a failure, keep taking deltas so the feed
+		// isn't left waiting. It gives up on its next write.
+		if (!failed) {
+			try {
+				append(delta);
+			} catch (const QuoterError&) {
+				failed = true;
+			}
+		}
+		if (delta.finished)
+			return;
+	}
+}
+
+void Checkpoint::append(Delta& delta) {
+	std::string records;
+	std::uint64_t last = 0, distinct = 0;
+	sumPairs(delta.pairs, [&](std::uint64_t pair, std::uint64_t count) {
+		putRecord(records, last, pair, count);
+		distinct++;
+	});
+	std::vector<std::uint64_t>().swap(delta.pairs);
+
+	std::string payload;
+	putVarint(payload, delta.offset);
+	unsigned char flags = 0;
+	if (delta.state.start_of_sentence)
+		flags |= FLAG_START_OF_SENTENCE;
+	if (delta.state.start_pending)
+		flags |= FLAG_START_PENDING;
+	if (delta.state.last_was_word)
+		flags |= FLAG_LAST_WAS_WORD;
+	if (delta.finished)
+		flags |= FLAG_FINISHED;
+	payload += (char)flags;
+	putVarint(payload, delta.lastCol);
+	putVarint(payload, delta.firstId);
+	putVarint(payload, delta.words.size());
+	std::vector<std::string>::iterator w;
+	for (w = delta.words.begin(); w != delta.words.end(); ++w) {
+		putVarint(payload, w->size());
+		payload += *w;
+	}
+	putVarint(payload, distinct);
+	payload += records;
+
+	// A delta only counts once it is on disk in full.
+	std::uint64_t len = payload.size(), sum = fnv1a(payload);
+	if (std::fwrite(&len, sizeof(len), 1, out) != 1 ||
+	    std::fwrite(payload.data(), 1, len, out) != len ||
+	    std::fwrite(&sum, sizeof(sum), 1, out) != 1 ||
+	    std::fflush(out) != 0 || fsync(fileno(out)) != 0)
+		throw QuoterError("Error in Checkpoint: Failed writing '" +
+				  filename + "'");
+}
+
+Checkpoint::Header Checkpoint::sourceHeader(const std::string& source,
+					    std::uint64_t base) {
+	Header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, JOURNAL_MAGIC, sizeof(h.magic));
+	h.version = JOURNAL_VERSION;
+	h.source = TokenCache::sourceStamp(source);
+	h.sourceName = fnv1a(source);
+	h.base = base;
+	return h;
+}
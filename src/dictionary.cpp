@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include "dictionary.hpp"
+#include "quoter.hpp"
+#include "tokenizer.hpp"
+
+// The sidecar has the same version line as the save files
+// referring to it.
+static const char *DICT_VERSION = "2 2";
+
+namespace {
+	// Directory part of a path, as dirname(3) would give it.
+	std::string dirName(const std::string& path) {
+		std::string::size_type slash = path.rfind('/');
+		if (slash == std::string::npos)
+			return ".";
+		return slash == 0 ? "/" : path.substr(0, slash);
+	}
+
+	std::vector<std::string> splitPath(const std::string& path) {
+		std::vector<std::string> parts;
+		std::string::size_type start = 0, end;
+		while (start < path.size()) {
+			end = path.find('/', start);
+			if (end == std::string::npos)
+				end = path.size();
+			if (end > start)
+				parts.push_back(path.substr(start, end - start));
+			start = end + 1;
+		}
+		return parts;
+	}
+}
+
+Dictionary::Dictionary():
+	// START and END markers don't require associated words.
+	// Just give them empty strings.
+	words((std::size_t)Tokenizer::Markers::NUM_ITEMS, std::string()),
+	savedSize(0) {}
+
+std::uint32_t Dictionary::intern(const std::string& word) {
+	std::unordered_map<std::string, std::uint32_t>::iterator it =
+		index.find(word);
+	if (it != index.end())
+		return it->second;
+
+	std::uint32_t id = words.size();
+	words.push_back(word);
+	index[word] = id;
+	return id;
+}
+
+const std::string& Dictionary::word(std::uint32_t id) const {
+	return words[id];
+}
+
+std::size_t Dictionary::size() const {
+	return words.size();
+}
+
+const std::string& Dictionary::path() const {
+	return filename;
+}
+
+std::string Dictionary::pathFrom(const std::string& saveFile) const {
+	std::vector<std::string> from = splitPath(canonicalPath(saveFile));
+	std::vector<std::string> to = splitPath(filename);
+	// Neither the save file's nor the sidecar's name is a directory.
+	from.pop_back();
+
+	std::size_t common = 0;
+	while (common < from.size() && common + 1 < to.size() &&
+	       from[common] == to[common])
+		common++;
+	std::string rel;
+	for (std::size_t i = common; i < from.size(); i++)
+		rel += "../";
+	for (std::size_t i = common; i < to.size(); i++) {
+		rel += to[i];
+		if (i + 1 < to.size())
+			rel += '/';
+	}
+	return rel;
+}
+
+void Dictionary::save() {
+	if (filename.empty() ||
+	    (words.size() == savedSize && access(filename.c_str(), F_OK) != -1))
+		return;
+
+	// Other processes may share the sidecar, so hold a lock from
+	// reading it to replacing it. The sidecar is replaced rather
+	// than rewritten, so the lock is a file of its own.
+	std::string lockPath = filename + ".lock";
+	int fd = ::open(lockPath.c_str(), O_RDWR | O_CREAT, 0666);
+	if (fd == -1 || flock(fd, LOCK_EX) != 0) {
+		if (fd != -1)
+			::close(fd);
+		std::string m = "Error in Dictionary::save: Cannot lock '";
+		m += lockPath;
+		m += "'";
+		throw QuoterError(m);
+	}
+	try {
+		saveLocked();
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+	::close(fd);
+}
+
+std::shared_ptr<Dictionary> Dictionary::open(const std::string& filename) {
+	static std::map<std::string, std::weak_ptr<Dictionary>> opened;
+
+	// Different spellings of the same path must not become separate
+	// dictionaries, or they would overwrite each other's sidecar.
+	std::string path = canonicalPath(filename);
+	std::shared_ptr<Dictionary> dict = opened[path].lock();
+	if (dict)
+		return dict;
+
+	dict = std::make_shared<Dictionary>();
+	if (access(path.c_str(), F_OK) != -1)
+		dict->readData(path);
+	dict->filename = path;
+	opened[path] = dict;
+	return dict;
+}
+
+std::string Dictionary::resolve(const std::string& path,
+				const std::string& saveFile) {
+	if (!path.empty() && path[0] == '/')
+		return path;
+	return dirName(saveFile) + "/" + path;
+}
+
+std::string Dictionary::canonicalPath(const std::string& path) {
+	// The file itself may not exist yet, so only resolve its directory.
+	std::string dir = dirName(path);
+	char resolved[PATH_MAX];
+	if (!realpath(dir.c_str(), resolved)) {
+		std::string m = "Error in Dictionary: Cannot resolve directory '";
+		m += dir;
+		m += "'";
+		throw QuoterError(m);
+	}
+	std::string base = path.substr(path.rfind('/') + 1);
+	std::string canonical(resolved);
+	if (canonical != "/")
+		canonical += '/';
+	return canonical + base;
+}
+
+void Dictionary::saveLocked() {
+	// Another process may have saved words since this one read the
+	// sidecar. Both must agree on every id they have, or save files
+	// written by one of them would refer to the wrong words.
+	std::vector<std::string> saved;
+	if (access(filename.c_str(), F_OK) != -1)
+		saved = readWords(filename);
+	std::size_t common = std::min(saved.size(), words.size());
+	if (!std::equal(words.begin(), words.begin() + common, saved.begin())) {
+		std::string m = "Error in Dictionary::save: Dictionary '";
+		m += filename;
+		m += "' has had other words added by another process";
+		throw QuoterError(m);
+	}
+
+	// The sidecar has all of these words already. Take on any it
+	// has beyond them, so that words added later get new ids.
+	if (saved.size() >= words.size()) {
+		for (std::size_t id = words.size(); id < saved.size(); id++) {
+			index[saved[id]] = id;
+			words.push_back(saved[id]);
+		}
+		savedSize = words.size();
+		return;
+	}
+
+	// Save files of other processes may refer to the sidecar,
+	// so never leave it half written.
+	std::string tmpPath = filename + ".tmp";
+	std::ofstream out(tmpPath);
+	if (!out.is_open()) {
+		std::string m = "Error in Dictionary::save: Cannot open file '";
+		m += tmpPath;
+		m += "' for writing";
+		throw QuoterError(m);
+	}
+	out << DICT_VERSION << '\n';
+	out << words.size() << '\n';
+	std::vector<std::string>::iterator word_it;
+	for (word_it = words.begin(); word_it != words.end(); ++word_it)
+		out << *word_it << '\n';
+	out.close();
+
+	if (out.fail() || std::rename(tmpPath.c_str(), filename.c_str()) != 0) {
+		std::remove(tmpPath.c_str());
+		std::string m = "Error in Dictionary::save: Cannot write '";
+		m += filename;
+		m += "'";
+		throw QuoterError(m);
+	}
+	savedSize = words.size();
+}
+
+void Dictionary::readData(std::string path) {
+	words = readWords(path);
+	index.clear();
+	for (std::size_t id = (std::size_t)Tokenizer::Markers::NUM_ITEMS;
+	     id < words.size(); id++)
+		index[words[id]] = id;
+	savedSize = words.size();
+}
+
+std::vector<std::string> Dictionary::readWords(const std::string& path) {
+	std::ifstream in(path);
+	if (!in.is_open()) {
+		std::string m = "Error in Dictionary::readWords: Cannot open file '";
+		m += path;
+		m += "' for reading";
+		throw QuoterError(m);
+	}
+
+	std::string buf;
+	std::uint64_t count = 0;
+	std::vector<std::string> newWords;
+	try {
+		if (!std::getline(in, buf) || buf != DICT_VERSION)
+			throw std::invalid_argument("Unknown version");
+		if (!std::getline(in, buf))
+			throw std::invalid_argument("Too few lines");
+		count = std::stoul(buf);
+		if (count < (std::uint64_t)Tokenizer::Markers::NUM_ITEMS)
+			throw std::invalid_argument("Too few words");
+		while (newWords.size() < count && std::getline(in, buf))
+			newWords.push_back(buf);
+		if (newWords.size() < count)
+			throw std::invalid_argument("Too few lines");
+	} catch (const std::logic_error& e) {
+		std::string m = "Error in Dictionary::readWords: ";
+		m += "Dictionary '";
+		m += path;
+		m += "' is corrupt: ";
+		m += e.what();
+		throw QuoterError(m);
+	}
+	return newWords;
+}
@@ -2,7 +2,5 @@
 #include "quoter.hpp"
 
 int main(int argc, char** argv) {
-	ArgParser::parseArgs(argc, argv);
-
-	return 0;
+	return ArgParser::parseArgs(argc, argv);
 }
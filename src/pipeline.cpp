@@ -0,0 +1,167 @@
+#include <atomic>
+#include <cctype>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include "pipeline.hpp"
+#include "quoter.hpp"
+#include "spscqueue.hpp"
+
+// Bytes read from the stream per batch.
+static const std::size_t BLOCK_SIZE = 256 * 1024;
+// Batches each queue holds before its producer has to wait.
+static const std::size_t QUEUE_DEPTH = 8;
+
+namespace {
+	struct Batch {
+		// Raw text, cut at whitespace. Filled by the reader.
+		std::string text;
+		// Scanned words of text. Filled by a tokenizer.
+		std::vector<Tokenizer::Word> words;
+		// Marks the end of the stream.
+		bool last;
+
+		Batch(): last(false) {}
+	};
+
+	typedef SpscQueue<Batch> BatchQueue;
+
+	// Whitespace as std::istream's operator>> sees it in the C locale.
+	bool isSpace(char c) {
+		return isspace((unsigned char)c);
+	}
+
+	void readStage(std::istream& in,
+		       std::vector<std::unique_ptr<BatchQueue>>& queues,
+		       std::atomic<bool>& stop, bool& failed) {
+		std::vector<char> buffer(BLOCK_SIZE);
+		std::string carry;
+		std::size_t seq = 0;
+		bool more = true;
+		while (more) {
+			in.read(buffer.data(), buffer.size());
+			std::size_t n = in.gcount();
+			more = n == buffer.size();
+
+			// Hold back a word that may continue in the next block.
+			std::size_t cut = n;
+			if (more)
+				while (cut > 0 && !isSpace(buffer[cut - 1]))
+					cut--;
+			if (more && cut == 0) {
+				carry.append(buffer.data(), n);
+				continue;
+			}
+
+			Batch batch;
+			batch.text.swap(carry);
+			batch.text.append(buffer.data(), cut);
+			carry.assign(buffer.data() + cut, n - cut);
+			if (!queues[seq++ % queues.size()]->push(batch, stop))
+				return;
+		}
+		failed = in.bad();
+
+		// Every tokenizer passes the end on, and the batch after the
+		// last one in round-robin order is always an end batch.
+		for (std::size_t i = 0; i < queues.size(); i++) {
+			Batch end;
+			end.last = true;
+			if (!queues[(seq + i) % queues.size()]->push(end, stop))
+				return;
+		}
+	}
+
+	void tokenizeStage(BatchQueue& in, BatchQueue& out,
+			   std::atomic<bool>& stop) {
+		Batch batch;
+		std::string raw;
+		while (in.pop(batch, stop)) {
+			if (!batch.last) {
+				const std::string& text = batch.text;
+				std::size_t i = 0, start;
+				while (i < text.size()) {
+					while (i < text.size() && isSpace(text[i]))
+						i++;
+					start = i;
+					while (i < text.size() && !isSpace(text[i]))
+						i++;
+					if (i > start) {
+						raw.assign(text, start, i - start);
+						batch.words.push_back(Tokenizer::scan(raw));
+					}
+				}
+				std::string().swap(batch.text);
+			}
+			bool last = batch.last;
+			if (!out.push(batch, stop) || last)
+				return;
+			batch = Batch();
+		}
+	}
+}
+
+void Pipeline::run(std::istream& in, unsigned int tokenizers,
+		   const std::function<void(std::vector<Tokenizer::Word>&)>& consume) {
+	if (tokenizers == 0)
+		tokenizers = 1;
+
+	std::vector<std::unique_ptr<BatchQueue>> raw, scanned;
+	for (unsigned int i = 0; i < tokenizers; i++) {
+		raw.emplace_back(new BatchQueue(QUEUE_DEPTH));
+		scanned.emplace_back(new BatchQueue(QUEUE_DEPTH));
+	}
+
+	std::atomic<bool> stop(false);
+	bool readFailed = false;
+	std::vector<std::thread> threads;
+	threads.emplace_back(readStage, std::ref(in), std::ref(raw),
+			     std::ref(stop), std::ref(readFailed));
+	for (unsigned int i = 0; i < tokenizers; i++)
+		threads.emplace_back(tokenizeStage, std::ref(*raw[i]),
+				     std::ref(*scanned[i]), std::ref(stop));
+
+	// Batches are handed out round-robin, so collecting them
+	// round-robin puts them back in stream order.
+	std::exception_ptr error;
+	try {
+		Batch batch;
+		for (std::size_t seq = 0; ; seq++) {
+			scanned[seq % tokenizers]->pop(batch, stop);
+			if (batch.last)
+				break;
+			consume(batch.words);
+		}
+	} catch (...) {
+		error = std::current_exception();
+		stop = true;
+	}
+
+	for (std::vector<std::thread>::iterator t = threads.begin();
+	     t != threads.end(); ++t)
+		t->join();
+
+	if (error)
+		std::rethrow_exception(error);
+	if (readFailed)
+		throw QuoterError("Error in Pipeline::run: Failed reading stream");
+}
+
+void Pipeline::feed(std::istream& in, unsigned int tokenizers,
+		    const std::vector<std::function<void(std::vector<Tokenizer::Item>&)>>& consumers) {
+	Tokenizer tokenizer;
+	std::vector<Tokenizer::Item> items;
+	std::size_t i;
+	run(in, tokenizers, [&](std::vector<Tokenizer::Word>& words) {
+		std::vector<Tokenizer::Word>::iterator w;
+		for (w = words.begin(); w != words.end(); ++w)
+			tokenizer.push(*w, items);
+		for (i = 0; i < consumers.size(); i++)
+			consumers[i](items);
+		items.clear();
+	});
+	tokenizer.finish(items);
+	for (i = 0; i < consumers.size(); i++)
+		consumers[i](items);
+}
@@ -1,14 +1,24 @@
 /* TODO
- *  - Seperate filtering from feed_stream.
  *  - Add compatibility for []'s, ()'s, "'s and 's that surround text.
  *  - Redefine errors.
- *  - Add merge function.
  */
 
+#include <algorithm>
+#include <cstdio>
 #include <stdexcept>
 #include <fstream>
 #include <sstream>
+#include "checkpoint.hpp"
+#include "hash.hpp"
 #include "quoter.hpp"
+#include "runfile.hpp"
+#include "tokencache.hpp"
+
+// Row of the item preceding the first item of a stream.
+static const std::uint32_t NO_ROW = UINT32_MAX;
+
+// Read buffer size for each run merged by feed_file_external.
+static const std::size_t RUN_BUFFER_SIZE = 64 * 1024;
 
 QuoterError::QuoterError(std::string m): msg(m) {}
 const char *QuoterError::what() const throw() {
@@ -21,146 +31,312 @@ Quoter::Quoter():
 	 bigram_array((int)Markers::NUM_ITEMS,
 		      std::vector<std::uint32_t> ((int)Markers::NUM_ITEMS, 0)),
 	 bigram_rowSums((int)Markers::NUM_ITEMS, 0),
-	 // START and END markers don't require associated words.
-	 // Just give them empty strings.
-	 bigram_words((int)Markers::NUM_ITEMS, std::string()) {
+	 dictionary(std::make_shared<Dictionary>()),
+	 bigram_ids((int)Markers::NUM_ITEMS),
+	 bigram_reachDirty(true) {
+	for (std::uint32_t id = 0; id < bigram_ids.size(); id++)
+		bigram_ids[id] = id;
 	std::random_device rd;
 	randGen.seed(rd());
 }
 
+Quoter::Quoter(std::shared_ptr<Dictionary> dict): Quoter() {
+	dictionary = dict;
+}
+
+Quoter::Quoter(const Quoter& other):
+	 randGen(other.randGen),
+	 bigram_array(other.bigram_array),
+	 bigram_rowSums(other.bigram_rowSums),
+	 dictionary(other.dictionary->path().empty() ?
+		    std::make_shared<Dictionary>(*other.dictionary) :
+		    other.dictionary),
+	 bigram_ids(other.bigram_ids),
+	 bigram_rows(other.bigram_rows),
+	 bigram_reachDirty(true) {
+	// Counts fed out of core belong to other, so load a copy.
+	if (other.bigram_pending) {
+		std::vector<std::uint32_t> rows(bigram_ids.size());
+		for (std::uint32_t row = 0; row < rows.size(); row++)
+			rows[row] = row;
+		addRun(other.bigram_pending->path(), rows);
+	}
+}
+
 void Quoter::feed_stream(std::istream& in) {
-	// Initialize pre-parser FIFO stack.
-	std::vector<ParserItem *> parserItems;
-
-	/// FIRST PARSING RUN ///
-	// Read words in one by one.
-	std::string word;
-	bool start_of_sentence = true, end_of_sentence = false;
-	Markers end_marker;
-	while (in >> word) {
-		// Check for end of sentence.
-		end_of_sentence = true;
-		if (word.find('.') != std::string::npos)
-			end_marker = Markers::PERIOD;
-		else if (word.find('!') != std::string::npos)
-			end_marker = Markers::EXCLAIM;
-		else if (word.find('?') != std::string::npos)
-			end_marker = Markers::QUESTION;
-		else
-			end_of_sentence = false;
+	Tokenizer tokenizer;
+	std::vector<Tokenizer::Item> items;
+	std::uint32_t lastCol = NO_ROW;
+	std::string raw;
+	while (in >> raw) {
+		Tokenizer::Word word = Tokenizer::scan(raw);
+		tokenizer.push(word, items);
+		countItems(items, lastCol);
+		items.clear();
+	}
+	tokenizer.finish(items);
+	countItems(items, lastCol);
+}
 
-		// Filter out unwanted characters.
-		word = filterWord(word);
+std::function<void(std::vector<Tokenizer::Item>&)> Quoter::itemCounter() {
+	std::uint32_t lastCol = NO_ROW;
+	return [this, lastCol](std::vector<Tokenizer::Item>& items) mutable {
+		countItems(items, lastCol);
+	};
+}
 
-		if (start_of_sentence) {
-			ParserItem_marker *newStart;
-			newStart = new ParserItem_marker(Markers::START);
-			parserItems.push_back(newStart);
-			start_of_sentence = false;
-		}
-		if (!word.empty()) {
-			ParserItem_word *newWord;
-			newWord = new ParserItem_word(word);
-			parserItems.push_back(newWord);
-		}
-		// Make sure at least one word is in the current sentence
-		// if it is being ended.
-		ParserItem& last = *parserItems.back();
-		if (end_of_sentence &&
-		    !(last.type == ParserItemTypes::MARKER &&
-		      ((ParserItem_marker&)last).marker == Markers::START)) {
-			ParserItem_marker *newEnd;
-			newEnd = new ParserItem_marker(end_marker);
-			parserItems.push_back(newEnd);
-			start_of_sentence = true;
-		}
+void Quoter::feed_file(std::string filePath) {
+	std::ifstream ifs(filePath.c_str());
+
+	if (!ifs.is_open()) {
+		std::string m = "Error in Quoter::feed: Could not open ";
+		m += filePath;
+		throw QuoterError(m);
 	}
 
-	// Mend end of stack if needed.
-	ParserItem& last = *parserItems.back();
-	if (last.type == ParserItemTypes::MARKER &&
-	    ((ParserItem_marker&) last).marker == Markers::START) {
-		parserItems.pop_back();
-	} else if (last.type == ParserItemTypes::WORD) {
-		ParserItem_marker *newEnd;
-		newEnd = new ParserItem_marker(Markers::PERIOD);
-		parserItems.push_back(newEnd);
+	std::istream& is = ifs;
+	feed_stream(is);
+	ifs.close();
+}
+
+void Quoter::feed_file_external(std::string filePath, std::string tempDir,
+				std::size_t memoryBudget) {
+	std::ifstream ifs(filePath.c_str());
+
+	if (!ifs.is_open()) {
+		std::string m = "Error in Quoter::feed_file_external: "
+			"Could not open ";
+		m += filePath;
+		throw QuoterError(m);
 	}
-	/// SECOND PARSING RUN ///
-	//TODO: Reduce indentations. Add helper functions and/or restructure.
-	std::uint32_t lastCol, row;
-	// Initialize lastCol with assumption that
-	// the first parser item is a START marker.
-	lastCol = (std::uint32_t) Markers::START;
-	// First parser item has been accounted for,
-	// so start iterator on second element.
-	for (std::vector<ParserItem *>::iterator token =
-	     parserItems.begin() + 1; token != parserItems.end(); ++token) {
-		switch ((*token)->type) {
-		case ParserItemTypes::MARKER: {
-			ParserItem_marker& mark_pi =
-				*((ParserItem_marker *)(*token));
-			row = (unsigned int)mark_pi.marker;
-			break;
-		} case ParserItemTypes::WORD: {
-			ParserItem_word& word_pi =
-				*((ParserItem_word *)(*token));
-			// Find row index of word in bigram array.
-			row = 0;
-			std::vector<std::string>::iterator w;
-			for (w = bigram_words.begin();
-			     w != bigram_words.end(); ++w) {
-				if (word_pi.word == *w)
-					break;
-				row++;
+
+	std::size_t maxPairs = std::max<std::size_t>(
+		memoryBudget / sizeof(std::uint64_t), 1);
+	std::vector<std::uint64_t> pairs;
+	pairs.reserve(maxPairs);
+	std::vector<std::string> runs;
+
+	// New words only get rows here. The array isn't grown to fit
+	// them, since the counts stay on disk.
+	Tokenizer tokenizer;
+	std::vector<Tokenizer::Item> items;
+	std::uint32_t lastCol = NO_ROW, row;
+	std::string raw;
+	bool more = true;
+	try {
+		while (more) {
+			if (ifs >> raw) {
+				Tokenizer::Word word = Tokenizer::scan(raw);
+				tokenizer.push(word, items);
+			} else {
+				tokenizer.finish(items);
+				more = false;
 			}
-			// If word does not yet exist in bigram array,
-			// add it.
-			if (row >= bigram_words.size()) {
-				bigram_words.push_back(word_pi.word);
-
-				// Extend all rows.
-				std::vector<std::vector<std::uint32_t>>::iterator r;
-				for (r = bigram_array.begin();
-				     r != bigram_array.end(); ++r)
-					r->push_back(0);
-
-				// Add rows.
-				std::vector<std::uint32_t> newRow(bigram_words.size(), 0);
-				bigram_array.push_back(newRow);
-				bigram_rowSums.push_back(0);
+
+			std::vector<Tokenizer::Item>::iterator it;
+			for (it = items.begin(); it != items.end(); ++it) {
+				if (it->type == Tokenizer::ItemTypes::MARKER)
+					row = (std::uint32_t)it->marker;
+				else
+					row = internWord(it->word);
+				if (lastCol != NO_ROW) {
+					if (pairs.size() == maxPairs) {
+						runs.push_back(spillRun(pairs, tempDir));
+						pairs.clear();
+					}
+					pairs.push_back((std::uint64_t)lastCol << 32 | row);
+				}
+				lastCol = row;
 			}
-			break;
-		} default:
-			std::cerr << "Error in Quoter::feed_stream: "
-				  << "Unexpected error in second parsing run."
-				  << std::endl;
+			items.clear();
 		}
+		if (!pairs.empty())
+			runs.push_back(spillRun(pairs, tempDir));
+	} catch (...) {
+		for (std::vector<std::string>::iterator r = runs.begin();
+		     r != runs.end(); ++r)
+			std::remove(r->c_str());
+		throw;
+	}
+	ifs.close();
 
-		bigram_array[lastCol][row]++;
-		bigram_rowSums[lastCol]++;
-
-		lastCol = row;
+	// Free the pair buffer so the merge gets the whole budget.
+	std::vector<std::uint64_t>().swap(pairs);
+	if (runs.empty())
+		return;
+	if (!bigram_pending && runs.size() == 1) {
+		bigram_pending.reset(new RunFile(runs.front()));
+		return;
 	}
 
-	//Delete parser items.
-	for (std::vector<ParserItem *>::iterator token = parserItems.begin();
-	     token != parserItems.end(); ++token)
-		delete *token;
+	// Merge everything fed out of core into a single run, which
+	// is in the same row-major order as the array. Earlier counts
+	// stay with their run until the merged one is complete, so a
+	// failed merge only loses this feed.
+	std::vector<std::string> inputs(runs), kept;
+	if (bigram_pending) {
+		kept.push_back(bigram_pending->path());
+		inputs.insert(inputs.begin(), kept.front());
+	}
+	std::string mergedPath;
+	try {
+		RunWriter merged(tempDir);
+		mergedPath = merged.path();
+		mergeRuns(inputs, kept, tempDir,
+			  memoryBudget / RUN_BUFFER_SIZE, RUN_BUFFER_SIZE,
+			  [&merged](std::uint64_t pair, std::uint64_t count) {
+				  merged.write(pair, count);
+			  });
+		merged.close();
+	} catch (...) {
+		for (std::vector<std::string>::iterator r = runs.begin();
+		     r != runs.end(); ++r)
+			std::remove(r->c_str());
+		if (!mergedPath.empty())
+			std::remove(mergedPath.c_str());
+		throw;
+	}
+	bigram_pending.reset(new RunFile(mergedPath));
 }
 
-void Quoter::feed_file(std::string filePath) {
+std::uint64_t Quoter::feed_file_checkpointed(std::string filePath,
+					     std::string journalPath,
+					     std::size_t interval) {
 	std::ifstream ifs(filePath.c_str());
 
 	if (!ifs.is_open()) {
-		std::string m = "Error in Quoter::feed: Could not open ";
+		std::string m = "Error in Quoter::feed_file_checkpointed: "
+			"Could not open ";
 		m += filePath;
 		throw QuoterError(m);
 	}
 
-	std::istream& is = ifs;
-	feed_stream(is);
-	ifs.close();
+	// Checkpoints build on the counts in the array.
+	loadPending();
+	Checkpoint journal(journalPath, filePath, stateFingerprint());
+	Tokenizer tokenizer;
+	Checkpoint::Delta delta;
+	delta.offset = 0;
+	delta.state = tokenizer.state();
+	delta.lastCol = NO_ROW;
+	delta.finished = false;
+	std::uint64_t row, col;
+	std::vector<std::string>::iterator w;
+	while (journal.resume(delta)) {
+		// Words get the same rows they got before, since the
+		// quoter is in the same state as it was then.
+		for (w = delta.words.begin(); w != delta.words.end(); ++w)
+			if (internWord(*w) != delta.firstId++)
+				throw QuoterError("Error in Quoter::feed_file_checkpointed: "
+						  "Journal " + journalPath +
+						  " doesn't match the dictionary");
+		resizeArray();
+		for (std::size_t i = 0; i < delta.pairs.size(); i++) {
+			row = delta.pairs[i] >> 32;
+			col = (std::uint32_t)delta.pairs[i];
+			if (row >= bigram_array.size() || col >= bigram_array.size())
+				throw QuoterError("Error in Quoter::feed_file_checkpointed: "
+						  "Journal " + journalPath +
+						  " is corrupt: Bad pair");
+			bigram_array[row][col] += delta.counts[i];
+			bigram_rowSums[row] += delta.counts[i];
+		}
+	}
+	std::uint64_t resumed = delta.offset;
+	if (delta.finished)
+		return resumed;
+
+	tokenizer.restore(delta.state);
+	std::uint32_t lastCol = delta.lastCol;
+	if (resumed)
+		ifs.seekg(resumed);
+
+	std::vector<Tokenizer::Item> items;
+	std::vector<std::uint64_t> pairs;
+	std::uint32_t savedWords = bigram_ids.size(), r;
+	std::size_t unsaved = 0;
+	std::string raw;
+	bool more = true;
+	while (more) {
+		if (ifs >> raw) {
+			Tokenizer::Word word = Tokenizer::scan(raw);
+			tokenizer.push(word, items);
+			unsaved += raw.size() + 1;
+		} else {
+			tokenizer.finish(items);
+			more = false;
+		}
+
+		std::vector<Tokenizer::Item>::iterator it;
+		for (it = items.begin(); it != items.end(); ++it) {
+			r = itemRow(*it);
+			if (lastCol != NO_ROW) {
+				bigram_array[lastCol][r]++;
+				bigram_rowSums[lastCol]++;
+				pairs.push_back((std::uint64_t)lastCol << 32 | r);
+			}
+			lastCol = r;
+		}
+		items.clear();
+
+		// Only checkpoint between words, where the offset is exact.
+		// A word ending the file is left to the final checkpoint.
+		if (more && (unsaved < interval || ifs.eof()))
+			continue;
+		if (!more) {
+			ifs.clear();
+			ifs.seekg(0, std::ios::end);
+		}
+		delta.offset = ifs.tellg();
+		delta.state = tokenizer.state();
+		delta.lastCol = lastCol;
+		delta.finished = !more;
+		delta.firstId = savedWords;
+		delta.words.clear();
+		for (; savedWords < bigram_ids.size(); savedWords++)
+			delta.words.push_back(
+				dictionary->word(bigram_ids[savedWords]));
+		delta.pairs.swap(pairs);
+		journal.write(delta);
+		pairs.clear();
+		unsaved = 0;
+	}
+	bigram_reachDirty = true;
+	journal.close();
+	return resumed;
+}
+
+void Quoter::feed_cache(std::string filePath) {
+	TokenCache cache(filePath);
+
+	// Words of the cache are stored in order of first appearance,
+	// so adding them up front gives them the rows feed_file would.
+	const std::vector<std::string>& words = cache.words();
+	std::vector<std::uint32_t> rows(words.size());
+	for (std::size_t i = 0; i < words.size(); i++)
+		if (i < (std::size_t)Markers::NUM_ITEMS)
+			rows[i] = i;
+		else
+			rows[i] = internWord(words[i]);
+	resizeArray();
+
+	std::vector<std::uint32_t> ids;
+	std::uint32_t lastCol = NO_ROW, row;
+	while (cache.read(ids)) {
+		std::vector<std::uint32_t>::iterator id;
+		for (id = ids.begin(); id != ids.end(); ++id) {
+			if (*id >= rows.size())
+				throw QuoterError("Error in Quoter::feed_cache: "
+						  "Cache of " + filePath +
+						  " is corrupt: Bad id");
+			row = rows[*id];
+			if (lastCol != NO_ROW) {
+				bigram_array[lastCol][row]++;
+				bigram_rowSums[lastCol]++;
+			}
+			lastCol = row;
+		}
+	}
 }
 
 void Quoter::feed_string(std::string text) {
@@ -170,66 +346,134 @@ void Quoter::feed_string(std::string text) {
 }
 
 std::string Quoter::buildSentence() {
-	std::string sentence;
+	return buildSentence(0, true);
+}
 
-	std::uint32_t row = (unsigned int)Markers::START;
-	std::uint32_t goal, sum, col;
+std::string Quoter::buildSentence(std::size_t maxWords, bool truncate) {
+	loadPending();
+	if (bigram_reachDirty)
+		findReachable();
+
+	std::uint32_t row = (std::uint32_t)Markers::START;
+	if (bigram_endSums[row] == 0)
+		throw QuoterError("Error in Quoter::buildSentence: "
+				  "Quoter has no sentences to build from");
+
+	// Only follow words a sentence can still end from, so every
+	// step keeps a sentence end within reach.
+	std::string sentence;
+	std::uint64_t goal, sum;
+	std::uint32_t col;
+	std::size_t wordCnt = 0;
 	while (true) {
-		goal = (randGen() % bigram_rowSums[row]) + 1;
-		sum = 0, col = row;
-		while (sum < goal) {
-			col = (col + 1) % bigram_array.size();
-			sum += bigram_array[row][col];
-		}
+		goal = randGen() % bigram_endSums[row];
+		sum = 0, col = (std::uint32_t)Markers::START;
+		do {
+			col++;
+			if (bigram_canEnd[col])
+				sum += bigram_array[row][col];
+		} while (sum <= goal);
 
 		if (col == (std::uint32_t)Markers::PERIOD) {
-			sentence.back() = '.';
+			sentence += '.';
 			break;
 		} else if (col == (std::uint32_t)Markers::EXCLAIM) {
-			sentence.back() = '!';
+			sentence += '!';
 			break;
 		} else if (col == (std::uint32_t)Markers::QUESTION) {
-			sentence.back() = '?';
+			sentence += '?';
 			break;
-		} else {
-			sentence += bigram_words[col];
-			sentence += ' ';
-			row = col;
 		}
+
+		if (maxWords && wordCnt == maxWords) {
+			if (!truncate)
+				throw QuoterError("Error in Quoter::buildSentence: "
+						  "Sentence is longer than " +
+						  std::to_string(maxWords) +
+						  " words");
+			sentence += '.';
+			break;
+		}
+		if (wordCnt++)
+			sentence += ' ';
+		sentence += dictionary->word(bigram_ids[col]);
+		row = col;
 	}
 
 	return sentence;
 }
 
 void Quoter::writeData(std::string filename) {
-	std::ofstream out(filename);
+	bool shared = !dictionary->path().empty();
+	if (shared)
+		dictionary->save();
+
+	// Checkpoints of feeds build on the old save file,
+	// so never leave it half written.
+	std::string tmpPath = filename + ".tmp";
+	std::ofstream out(tmpPath);
 	if (!out.is_open()) {
 		std::string m =
 		    "Error in Quoter::writeData: Cannot open file '";
-		m += filename;
+		m += tmpPath;
 		m += "' for writing";
 		throw QuoterError(m);
 	}
 	// Write major and minor version.
-	out << save_format.major << ' ' << save_format.minor << '\n';
+	if (shared)
+		out << save_format.major << ' ' << save_format.minor << '\n';
+	else
+		out << save_format_private.major << ' '
+		    << save_format_private.minor << '\n';
+
+	// Write path of shared dictionary.
+	if (shared)
+		out << dictionary->pathFrom(filename) << '\n';
 
 	// Write word count.
-	out << bigram_array.size() << '\n';
-
-	// Write words.
-	std::vector<std::string>::iterator word_it;
-	for (word_it = bigram_words.begin();
-	     word_it != bigram_words.end(); ++word_it)
-		out << *word_it << '\n';
-
-	// Write array data.
-	std::vector<std::vector<std::uint32_t>>::iterator row_it;
-	std::vector<std::uint32_t>::iterator col_it;
-	for (row_it = bigram_array.begin(); row_it != bigram_array.end();
-	     ++row_it)
-		for (col_it = row_it->begin(); col_it != row_it->end();
-		     ++col_it)
-			out << *col_it << '\n';
+	out << bigram_ids.size() << '\n';
+
+	// Write words, or their ids in a shared dictionary.
+	std::vector<std::uint32_t>::iterator id;
+	for (id = bigram_ids.begin(); id != bigram_ids.end(); ++id)
+		if (shared)
+			out << *id << '\n';
+		else
+			out << dictionary->word(*id) << '\n';
+
+	// Write array data. Counts fed out of core are added on the
+	// fly, since their run is in the same order.
+	std::unique_ptr<RunReader> pending;
+	std::uint64_t pair = UINT64_MAX, count = 0;
+	if (bigram_pending) {
+		pending.reset(new RunReader(bigram_pending->path(),
+					    RUN_BUFFER_SIZE));
+		if (!pending->next(pair, count))
+			pair = UINT64_MAX;
+	}
+	std::size_t size = bigram_ids.size();
+	for (std::uint64_t row = 0; row < size; row++)
+		for (std::uint64_t col = 0; col < size; col++) {
+			std::uint64_t n = 0;
+			if (row < bigram_array.size() &&
+			    col < bigram_array[row].size())
+				n = bigram_array[row][col];
+			if (pair == (row << 32 | col)) {
+				n += count;
+				if (!pending->next(pair, count))
+					pair = UINT64_MAX;
+			}
+			out << n << '\n';
+		}
+	out.close();
+
+	if (out.fail() || std::rename(tmpPath.c_str(), filename.c_str()) != 0) {
+		std::remove(tmpPath.c_str());
+		std::string m = "Error in Quoter::writeData: Cannot write '";
+		m += filename;
+		m += "'";
+		throw QuoterError(m);
+	}
 }
 
 void Quoter::readData(std::string filename) {
@@ -244,9 +488,10 @@ void Quoter::readData(std::string filename) {
 	std::uint64_t wordCnt, row, col;
 	std::vector<std::vector<std::uint32_t>> newArray;
 	std::vector<std::string> newWords;
+	std::string dictPath;
 
 	try {
-		Quoter::parseData(in, wordCnt, newArray, newWords);
+		Quoter::parseData(in, wordCnt, newArray, newWords, dictPath);
 	} catch (const std::logic_error& e) {
 		// Errors thrown by std::stoi.
 		std::string m = "Error in Quoter::readData: ";
@@ -256,6 +501,9 @@ void Quoter::readData(std::string filename) {
 		m += e.what();
 		throw QuoterError(m);
 	} catch (const QuoterError& e) {
+		// Unsupported version.
+		if (*e.what())
+			throw;
 		// Too few lines
 		std::string m = "Error in Quoter::readData: ";
 		m += "Save file '";
@@ -265,15 +513,97 @@ void Quoter::readData(std::string filename) {
 		throw QuoterError(m);
 	}
 
-	bigram_words = newWords;
+	std::shared_ptr<Dictionary> newDict;
+	std::vector<std::uint32_t> newIds(wordCnt);
+	for (row = 0; row < (std::uint64_t)Markers::NUM_ITEMS; row++)
+		newIds[row] = row;
+	if (dictPath.empty()) {
+		newDict = std::make_shared<Dictionary>();
+		for (row = (std::uint64_t)Markers::NUM_ITEMS; row < wordCnt; row++)
+			if (newWords[row].empty() ||
+			    newDict->intern(newWords[row]) != row) {
+				std::string m = "Error in Quoter::readData: ";
+				m += "Save file '";
+				m += filename;
+				m += "' is corrupt: Bad word '";
+				m += newWords[row];
+				m += "'";
+				throw QuoterError(m);
+			} else {
+				newIds[row] = row;
+			}
+	} else {
+		newDict = Dictionary::open(Dictionary::resolve(dictPath, filename));
+		std::vector<bool> seen(newDict->size(), false);
+		for (row = (std::uint64_t)Markers::NUM_ITEMS; row < wordCnt; row++) {
+			std::uint64_t id = 0;
+			try {
+				id = std::stoul(newWords[row]);
+			} catch (const std::logic_error&) {
+			}
+			if (id < (std::uint64_t)Markers::NUM_ITEMS ||
+			    id >= newDict->size() || seen[id]) {
+				std::string m = "Error in Quoter::readData: ";
+				m += "Save file '";
+				m += filename;
+				m += "' has a bad id for dictionary '";
+				m += dictPath;
+				m += "': '";
+				m += newWords[row];
+				m += "'";
+				throw QuoterError(m);
+			}
+			seen[id] = true;
+			newIds[row] = id;
+		}
+	}
+
+	dictionary = newDict;
+	bigram_pending.reset();
+	bigram_ids = newIds;
+	bigram_rows.clear();
+	for (row = 0; row < wordCnt; row++)
+		if (bigram_ids[row] != row)
+			bigram_rows[bigram_ids[row]] = row;
 	bigram_array = newArray;
 	bigram_rowSums = std::vector<std::uint32_t> (wordCnt, 0);
 	for (row = 0; row < wordCnt; row++)
 		for (col = 0; col < wordCnt; col++)
 			bigram_rowSums[row] += bigram_array[row][col];
+	bigram_reachDirty = true;
+}
+
+void Quoter::merge(const Quoter& other) {
+	// With the same dictionary, words are matched by id.
+	std::size_t size = other.bigram_ids.size();
+	std::vector<std::uint32_t> rows(size);
+	for (std::size_t i = 0; i < size; i++)
+		if (dictionary == other.dictionary)
+			rows[i] = idRow(other.bigram_ids[i]);
+		else if (i < (std::size_t)Markers::NUM_ITEMS)
+			rows[i] = i;
+		else
+			rows[i] = internWord(
+				other.dictionary->word(other.bigram_ids[i]));
+	resizeArray();
+
+	for (std::size_t row = 0; row < other.bigram_array.size(); row++)
+		for (std::size_t col = 0; col < other.bigram_array[row].size();
+		     col++) {
+			std::uint32_t count = other.bigram_array[row][col];
+			bigram_array[rows[row]][rows[col]] += count;
+			bigram_rowSums[rows[row]] += count;
+		}
+	if (other.bigram_pending)
+		addRun(other.bigram_pending->path(), rows);
+}
+
+std::shared_ptr<Dictionary> Quoter::getDictionary() const {
+	return dictionary;
 }
 
 void Quoter::emitArray() {
+	loadPending();
 	std::vector<std::vector<std::uint32_t>>::iterator row;
 	std::vector<std::uint32_t>::iterator col;
 	for (row = bigram_array.begin(); row != bigram_array.end(); ++row) {
@@ -285,13 +615,19 @@ void Quoter::emitArray() {
 }
 
 void Quoter::checkVersion(Quoter::save_format_version v) {
-	if (v.major != save_format.major || v.minor != save_format.minor) {
+	if (v.major != save_format.major ||
+	    v.minor < save_format_private.minor ||
+	    v.minor > save_format.minor) {
 		std::string m = "Error in Quoter::readData: "
 			"File format version is ";
 		m += std::to_string(v.major);
 		m += ".";
 		m += std::to_string(v.minor);
-		m += "; it should be ";
+		m += "; it should be between ";
+		m += std::to_string(save_format_private.major);
+		m += ".";
+		m += std::to_string(save_format_private.minor);
+		m += " and ";
 		m += std::to_string(save_format.major);
 		m += ".";
 		m += std::to_string(save_format.minor);
@@ -315,31 +651,43 @@ Quoter::save_format_version Quoter::readVersion(std::string buf) {
 
 void Quoter::parseData(std::ifstream& in, std::uint64_t& count,
 		       std::vector<std::vector<std::uint32_t>>& vecs,
-		       std::vector<std::string>& words) {
+		       std::vector<std::string>& words, std::string& dictPath) {
 	std::uint64_t row, col;
 	std::string buf;
+	struct save_format_version v;
 	int state = 0;
 	while (std::getline(in, buf)) {
 		switch (state) {
 		case 0:
-			checkVersion(readVersion(buf));
-			state++;
+			v = readVersion(buf);
+			checkVersion(v);
+			// Only save files with a shared dictionary
+			// have a dictionary path.
+			state = v.minor == save_format_private.minor ? 2 : 1;
 			break;
 		case 1:
+			// Get dictionary path.
+			dictPath = buf;
+			state++;
+			break;
+		case 2:
 			// Get word count.
 			count = std::stoi(buf);
+			if (count < (std::uint64_t)Markers::NUM_ITEMS)
+				throw std::invalid_argument("Too few words");
 			state++;
 			row = 1;
 			break;
-		case 2:
-			// Get words.
+		case 3:
+			// Get words. If the dictionary is shared, its
+			// sidecar file has the words and these are ids.
 			words.push_back(buf);
 			if (row++ == count) {
 				row = 0, col = 0;
 				state++;
 			}
 			break;
-		case 3:
+		case 4:
 			// Get array data.
 			if (col == 0)
 				vecs.push_back(std::vector<std::uint32_t> ());
@@ -361,19 +709,146 @@ void Quoter::parseData(std::ifstream& in, std::uint64_t& count,
 	}
 
 	// Too few lines. Throw dummy back to parent, who has the filename.
-	if (state <= 3)
+	if (state <= 4)
 		throw QuoterError(std::string());
 }
 
-std::string Quoter::filterWord(std::string& word) {
-	char filtered[word.size()];
-	unsigned int i = 0;
-	for (std::string::iterator it = word.begin(); it != word.end(); it++)
-		if (isalnum(*it) || (*it >= '#' && *it <= '\'') ||
-		    (*it == ',') || (*it == '-') || (*it == '@'))
-			filtered[i++] = *it;
+std::uint32_t Quoter::internWord(const std::string& word) {
+	return idRow(dictionary->intern(word));
+}
+
+std::uint32_t Quoter::idRow(std::uint32_t id) {
+	if (id < bigram_ids.size() && bigram_ids[id] == id)
+		return id;
+	std::unordered_map<std::uint32_t, std::uint32_t>::iterator it =
+		bigram_rows.find(id);
+	if (it != bigram_rows.end())
+		return it->second;
+
+	// The array isn't grown to fit new rows here.
+	std::uint32_t row = bigram_ids.size();
+	bigram_ids.push_back(id);
+	if (row != id)
+		bigram_rows[id] = row;
+	return row;
+}
+
+std::uint32_t Quoter::itemRow(Tokenizer::Item& item) {
+	if (item.type == Tokenizer::ItemTypes::MARKER)
+		return (std::uint32_t)item.marker;
+
+	std::uint32_t row = internWord(item.word);
+	// If word did not yet exist in bigram array, add it.
+	if (row >= bigram_array.size())
+		resizeArray();
+	return row;
+}
+
+void Quoter::resizeArray() {
+	std::size_t size = bigram_ids.size();
+
+	// Extend all rows.
+	std::vector<std::vector<std::uint32_t>>::iterator r;
+	for (r = bigram_array.begin(); r != bigram_array.end(); ++r)
+		r->resize(size, 0);
+
+	// Add rows.
+	bigram_array.resize(size, std::vector<std::uint32_t>(size, 0));
+	bigram_rowSums.resize(size, 0);
+	bigram_reachDirty = true;
+}
+
+void Quoter::addRun(const std::string& path,
+		    const std::vector<std::uint32_t>& rows) {
+	resizeArray();
+	RunReader run(path, RUN_BUFFER_SIZE);
+	std::uint64_t pair, count;
+	while (run.next(pair, count)) {
+		std::uint64_t prev = pair >> 32, next = (std::uint32_t)pair;
+		if (prev >= rows.size() || next >= rows.size())
+			throw QuoterError("Error in Quoter::addRun: Run file '" +
+					  path + "' is corrupt: Bad pair");
+		bigram_array[rows[prev]][rows[next]] += count;
+		bigram_rowSums[rows[prev]] += count;
+	}
+	bigram_reachDirty = true;
+}
 
-	filtered[i] = '\0';
+void Quoter::loadPending() {
+	if (!bigram_pending)
+		return;
+	std::vector<std::uint32_t> rows(bigram_ids.size());
+	for (std::uint32_t row = 0; row < rows.size(); row++)
+		rows[row] = row;
+	addRun(bigram_pending->path(), rows);
+	bigram_pending.reset();
+}
 
-	return std::string(filtered);
+void Quoter::countItems(std::vector<Tokenizer::Item>& items,
+			std::uint32_t& lastCol) {
+	std::uint32_t row;
+	std::vector<Tokenizer::Item>::iterator it;
+	for (it = items.begin(); it != items.end(); ++it) {
+		row = itemRow(*it);
+		if (lastCol != NO_ROW) {
+			bigram_array[lastCol][row]++;
+			bigram_rowSums[lastCol]++;
+		}
+		lastCol = row;
+	}
+	if (!items.empty())
+		bigram_reachDirty = true;
+}
+
+void Quoter::findReachable() {
+	std::size_t size = bigram_array.size();
+
+	// Walk backwards from the end markers along nonzero counts.
+	// START is never sampled, so don't walk through it.
+	std::vector<std::vector<std::uint32_t>> preds(size);
+	for (std::size_t row = 0; row < size; row++)
+		for (std::size_t col = 0; col < size; col++)
+			if (bigram_array[row][col] &&
+			    col != (std::size_t)Markers::START)
+				preds[col].push_back(row);
+
+	bigram_canEnd.assign(size, false);
+	std::vector<std::uint32_t> queue;
+	queue.push_back((std::uint32_t)Markers::PERIOD);
+	queue.push_back((std::uint32_t)Markers::EXCLAIM);
+	queue.push_back((std::uint32_t)Markers::QUESTION);
+	for (std::size_t i = 0; i < queue.size(); i++)
+		bigram_canEnd[queue[i]] = true;
+	for (std::size_t i = 0; i < queue.size(); i++) {
+		std::vector<std::uint32_t>::iterator p;
+		for (p = preds[queue[i]].begin(); p != preds[queue[i]].end(); ++p)
+			if (!bigram_canEnd[*p]) {
+				bigram_canEnd[*p] = true;
+				queue.push_back(*p);
+			}
+	}
+
+	bigram_endSums.assign(size, 0);
+	for (std::size_t row = 0; row < size; row++)
+		for (std::size_t col = (std::size_t)Markers::START + 1;
+		     col < size; col++)
+			if (bigram_canEnd[col])
+				bigram_endSums[row] += bigram_array[row][col];
+	bigram_reachDirty = false;
+}
+
+std::uint64_t Quoter::stateFingerprint() const {
+	// 64-bit FNV-1a over the words of the rows and every count. Row
+	// sums alone would miss counts moved between cells of a row.
+	std::uint64_t h = FNV1A_BASIS;
+	for (std::uint32_t row = 0; row < bigram_ids.size(); row++) {
+		h = fnv1a(dictionary->word(bigram_ids[row]), h);
+		h = fnv1a("\xff", 1, h);
+	}
+	std::uint64_t size = bigram_array.size();
+	h = fnv1a(&size, sizeof(size), h);
+	std::vector<std::vector<std::uint32_t>>::const_iterator row;
+	for (row = bigram_array.begin(); row != bigram_array.end(); ++row)
+		h = fnv1a(row->data(), row->size() * sizeof(std::uint32_t), h);
+	return h;
 }
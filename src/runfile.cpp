@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cstdio>
+#include <queue>
+#include <memory>
+#include <stdlib.h>
+#include <unistd.h>
+#include "quoter.hpp"
+#include "runfile.hpp"
+
+RunWriter::RunWriter(const std::string& dir): last(0) {
+	std::string templ = dir + "/bigram_quoter.run.XXXXXX";
+	std::vector<char> name(templ.begin(), templ.end());
+	name.push_back('\0');
+	int fd = mkstemp(name.data());
+	if (fd == -1) {
+		std::string m = "Error in RunWriter: Cannot create run file in '";
+		m += dir;
+		m += "'";
+		throw QuoterError(m);
+	}
+	::close(fd);
+	filename = name.data();
+
+	out.open(filename, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::remove(filename.c_str());
+		std::string m = "Error in RunWriter: Cannot open file '";
+		m += filename;
+		m += "' for writing";
+		throw QuoterError(m);
+	}
+}
+
+void RunWriter::write(std::uint64_t pair, std::uint64_t count) {
+	record.clear();
+	putRecord(record, last, pair, count);
+	out.write(record.data(), record.size());
+}
+
+void RunWriter::close() {
+	out.close();
+	if (out.fail()) {
+		std::string m = "Error in RunWriter: Failed writing '";
+		m += filename;
+		m += "'";
+		throw QuoterError(m);
+	}
+}
+
+const std::string& RunWriter::path() const {
+	return filename;
+}
+
+RunReader::RunReader(const std::string& path, std::size_t bufferSize):
+	filename(path),
+	in(path, std::ios::binary),
+	buffer(std::max(bufferSize, 2 * MAX_VARINT_BYTES)),
+	pos(0),
+	len(0),
+	last(0) {
+	if (!in.is_open()) {
+		std::string m = "Error in RunReader: Cannot open file '";
+		m += filename;
+		m += "' for reading";
+		throw QuoterError(m);
+	}
+}
+
+bool RunReader::next(std::uint64_t& pair, std::uint64_t& count) {
+	if (len - pos < 2 * MAX_VARINT_BYTES)
+		fill();
+	if (pos == len)
+		return false;
+
+	// With less than a whole record's worth left, the run is cut short.
+	std::size_t avail = len - pos;
+	if (!getRecord(buffer.data(), len, pos, last, pair, count)) {
+		std::string m = "Error in RunReader: Run file '";
+		m += filename;
+		m += avail < 2 * MAX_VARINT_BYTES ? "' is truncated" : "' is corrupt";
+		throw QuoterError(m);
+	}
+	return true;
+}
+
+void RunReader::fill() {
+	// Move what's left to the front and top the buffer up.
+	std::copy(buffer.begin() + pos, buffer.begin() + len, buffer.begin());
+	len -= pos;
+	pos = 0;
+	in.read(buffer.data() + len, buffer.size() - len);
+	len += in.gcount();
+}
+
+RunFile::RunFile(const std::string& path): filename(path) {}
+
+RunFile::~RunFile() {
+	if (!filename.empty())
+		std::remove(filename.c_str());
+}
+
+const std::string& RunFile::path() const {
+	return filename;
+}
+
+std::string RunFile::release() {
+	std::string path;
+	path.swap(filename);
+	return path;
+}
+
+void putVarint(std::string& buf, std::uint64_t v) {
+	while (v >= 0x80) {
+		buf += (char)(v | 0x80);
+		v >>= 7;
+	}
+	buf += (char)v;
+}
+
+bool getVarint(const char *buf, std::size_t len, std::size_t& pos,
+	       std::uint64_t& v) {
+	v = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		if (pos == len)
+			return false;
+		unsigned char b = buf[pos++];
+		v |= (std::uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void putRecord(std::string& buf, std::uint64_t& last, std::uint64_t pair,
+	       std::uint64_t count) {
+	putVarint(buf, pair - last);
+	putVarint(buf, count);
+	last = pair;
+}
+
+bool getRecord(const char *buf, std::size_t len, std::size_t& pos,
+	       std::uint64_t& last, std::uint64_t& pair, std::uint64_t& count) {
+	std::uint64_t delta;
+	if (!getVarint(buf, len, pos, delta) || !getVarint(buf, len, pos, count))
+		return false;
+	last += delta;
+	pair = last;
+	return true;
+}
+
+void sumPairs(std::vector<std::uint64_t>& pairs,
+	      const std::function<void(std::uint64_t, std::uint64_t)>& emit) {
+	std::sort(pairs.begin(), pairs.end());
+	std::vector<std::uint64_t>::iterator it = pairs.begin();
+	while (it != pairs.end()) {
+		std::vector<std::uint64_t>::iterator end =
+			std::upper_bound(it, pairs.end(), *it);
+		emit(*it, end - it);
+		it = end;
+	}
+}
+
+std::string spillRun(std::vector<std::uint64_t>& pairs, const std::string& dir) {
+	RunWriter run(dir);
+	try {
+		sumPairs(pairs, [&run](std::uint64_t pair, std::uint64_t count) {
+			run.write(pair, count);
+		});
+		run.close();
+	} catch (...) {
+		std::remove(run.path().c_str());
+		throw;
+	}
+	return run.path();
+}
+
+namespace {
+	struct MergeHead {
+		std::uint64_t pair, count;
+		std::size_t run;
+
+		bool operator>(const MergeHead& other) const {
+			return pair > other.pair;
+		}
+	};
+
+	// Merges one group of runs, all of which are open at once.
+	void mergeGroup(const std::vector<std::string>& runs,
+			std::size_t bufferSize,
+			const std::function<void(std::uint64_t, std::uint64_t)>& emit) {
+		std::vector<std::unique_ptr<RunReader>> readers;
+		std::priority_queue<MergeHead, std::vector<MergeHead>,
+				    std::greater<MergeHead>> heads;
+		for (std::size_t i = 0; i < runs.size(); i++) {
+			readers.emplace_back(new RunReader(runs[i], bufferSize));
+			MergeHead h;
+			h.run = i;
+			if (readers[i]->next(h.pair, h.count))
+				heads.push(h);
+		}
+
+		while (!heads.empty()) {
+			MergeHead h = heads.top();
+			heads.pop();
+			std::uint64_t pair = h.pair, count = h.count;
+			if (readers[h.run]->next(h.pair, h.count))
+				heads.push(h);
+			while (!heads.empty() && heads.top().pair == pair) {
+				h = heads.top();
+				heads.pop();
+				count += h.count;
+				if (readers[h.run]->next(h.pair, h.count))
+					heads.push(h);
+			}
+			emit(pair, count);
+		}
+	}
+
+	void removeRuns(const std::vector<std::string>& runs,
+			const std::vector<std::string>& kept) {
+		std::vector<std::string>::const_iterator it;
+		for (it = runs.begin(); it != runs.end(); ++it)
+			if (std::find(kept.begin(), kept.end(), *it) == kept.end())
+				std::remove(it->c_str());
+	}
+}
+
+void mergeRuns(std::vector<std::string> runs,
+	       const std::vector<std::string>& kept, const std::string& dir,
+	       std::size_t fanIn, std::size_t bufferSize,
+	       const std::function<void(std::uint64_t, std::uint64_t)>& emit) {
+	fanIn = std::max<std::size_t>(fanIn, 2);
+	try {
+		// Merge the oldest runs down into intermediate runs
+		// until the rest can be read at once.
+		while (runs.size() > fanIn) {
+			std::vector<std::string> group(runs.begin(),
+						       runs.begin() + fanIn);
+			RunWriter merged(dir);
+			runs.push_back(merged.path());
+			mergeGroup(group, bufferSize,
+				   [&merged](std::uint64_t pair, std::uint64_t count) {
+					   merged.write(pair, count);
+				   });
+			merged.close();
+			removeRuns(group, kept);
+			runs.erase(runs.begin(), runs.begin() + fanIn);
+		}
+		mergeGroup(runs, bufferSize, emit);
+	} catch (...) {
+		removeRuns(runs, kept);
+		throw;
+	}
+	removeRuns(runs, kept);
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "hash.hpp"
+#include "sketchquoter.hpp"
+
+// Word keys have their top bit set so they never collide
+// with the keys of the markers, which are their indices.
+static const std::uint64_t WORD_KEY_BIT = 1ULL << 63;
+
+// Finalizer of splitmix64. Spreads keys over the sketch rows.
+static std::uint64_t mix(std::uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+SketchQuoter::SketchQuoter(std::size_t w, std::size_t d,
+			   std::size_t words, std::size_t successors):
+	width(std::max<std::size_t>(w, 1)),
+	depth(std::max<std::size_t>(d, 1)),
+	maxWords(words),
+	maxSuccessors(std::max<std::size_t>(successors, 1)),
+	randGen(),
+	pairSketch(width * depth, 0),
+	wordSketch(width * depth, 0),
+	minEntry(0),
+	minValid(false) {
+	std::random_device rd;
+	randGen.seed(rd());
+
+	for (std::uint32_t m = 0; m < (std::uint32_t)Markers::NUM_ITEMS; m++) {
+		Entry marker;
+		marker.key = m;
+		marker.count = 0;
+		entries.push_back(marker);
+		entryIndex[m] = m;
+	}
+}
+
+void SketchQuoter::feed_stream(std::istream& in) {
+	Tokenizer tokenizer;
+	std::vector<Tokenizer::Item> items;
+	std::uint64_t lastKey = 0;
+	bool haveLast = false;
+	std::string raw;
+	while (in >> raw) {
+		Tokenizer::Word word = Tokenizer::scan(raw);
+		tokenizer.push(word, items);
+		countItems(items, lastKey, haveLast);
+		items.clear();
+	}
+	tokenizer.finish(items);
+	countItems(items, lastKey, haveLast);
+}
+
+std::function<void(std::vector<Tokenizer::Item>&)> SketchQuoter::itemCounter() {
+	std::uint64_t lastKey = 0;
+	bool haveLast = false;
+	return [this, lastKey, haveLast](std::vector<Tokenizer::Item>& items) mutable {
+		countItems(items, lastKey, haveLast);
+	};
+}
+
+void SketchQuoter::feed_file(std::string filePath) {
+	std::ifstream ifs(filePath.c_str());
+
+	if (!ifs.is_open()) {
+		std::string m = "Error in SketchQuoter::feed: Could not open ";
+		m += filePath;
+		throw QuoterError(m);
+	}
+
+	std::istream& is = ifs;
+	feed_stream(is);
+	ifs.close();
+}
+
+void SketchQuoter::feed_string(std::string text) {
+	std::istringstream iss(text);
+	std::istream& is = iss;
+	feed_stream(is);
+}
+
+std::string SketchQuoter::buildSentence() {
+	return buildSentence(0, true);
+}
+
+std::string SketchQuoter::buildSentence(std::size_t wordLimit, bool truncate) {
+	// Without reachability information a walk may never hit an end,
+	// so there is always a limit.
+	std::size_t limit = wordLimit ? wordLimit : maxSentenceWords;
+	std::string sentence;
+	std::vector<const Successor *> candidates;
+	std::size_t row = (std::size_t)Markers::START, wordCnt = 0;
+	while (true) {
+		// Only successors that still have a row can be followed.
+		std::uint64_t total = 0;
+		candidates.clear();
+		std::vector<Successor>::const_iterator s;
+		for (s = entries[row].successors.begin();
+		     s != entries[row].successors.end(); ++s) {
+			if (s->key == (std::uint64_t)Markers::START ||
+			    !entryIndex.count(s->key))
+				continue;
+			candidates.push_back(&*s);
+			total += s->count;
+		}
+		if (total == 0)
+			break;
+
+		std::uint64_t goal = randGen() % total, sum = 0;
+		std::vector<const Successor *>::iterator c = candidates.begin();
+		while ((sum += (*c)->count) <= goal)
+			++c;
+
+		if ((*c)->key == (std::uint64_t)Markers::PERIOD) {
+			sentence += '.';
+			return sentence;
+		} else if ((*c)->key == (std::uint64_t)Markers::EXCLAIM) {
+			sentence += '!';
+			return sentence;
+		} else if ((*c)->key == (std::uint64_t)Markers::QUESTION) {
+			sentence += '?';
+			return sentence;
+		}
+
+		if (wordCnt == limit) {
+			if (!truncate)
+				throw QuoterError("Error in SketchQuoter::buildSentence: "
+						  "Sentence is longer than " +
+						  std::to_string(limit) +
+						  " words");
+			break;
+		}
+		row = entryIndex[(*c)->key];
+		if (!sentence.empty())
+			sentence += ' ';
+		sentence += entries[row].word;
+		wordCnt++;
+	}
+
+	if (sentence.empty())
+		throw QuoterError("Error in SketchQuoter::buildSentence: "
+				  "Quoter has no sentences to build from");
+	// Dead end or too long. End the sentence where it is.
+	sentence += '.';
+	return sentence;
+}
+
+Quoter SketchQuoter::toQuoter() {
+	Quoter q;
+	std::vector<std::uint32_t> rows(entries.size());
+	for (std::size_t i = 0; i < entries.size(); i++)
+		if (i < (std::size_t)Markers::NUM_ITEMS)
+			rows[i] = i;
+		else
+			rows[i] = q.internWord(entries[i].word);
+	q.resizeArray();
+
+	for (std::size_t i = 0; i < entries.size(); i++) {
+		std::vector<Successor>::iterator s;
+		for (s = entries[i].successors.begin();
+		     s != entries[i].successors.end(); ++s) {
+			std::unordered_map<std::uint64_t, std::uint32_t>::iterator e =
+				entryIndex.find(s->key);
+			if (e == entryIndex.end())
+				continue;
+			q.bigram_array[rows[i]][rows[e->second]] += s->count;
+			q.bigram_rowSums[rows[i]] += s->count;
+		}
+	}
+	return q;
+}
+
+void SketchQuoter::writeData(std::string filename) {
+	toQuoter().writeData(filename);
+}
+
+std::uint64_t SketchQuoter::itemKey(const Tokenizer::Item& item) {
+	if (item.type == Tokenizer::ItemTypes::MARKER)
+		return (std::uint64_t)item.marker;
+
+	return fnv1a(item.word) | WORD_KEY_BIT;
+}
+
+std::uint32_t SketchQuoter::sketchAdd(std::vector<std::uint32_t>& sketch,
+				      std::uint64_t key) {
+	// Conservative update: only the counters holding the current
+	// estimate are raised, since the others already overestimate.
+	std::uint32_t est = UINT32_MAX;
+	for (std::size_t d = 0; d < depth; d++)
+		est = std::min(est, sketch[d * width + mix(key + d) % width]);
+	if (est == UINT32_MAX)
+		return est;
+	for (std::size_t d = 0; d < depth; d++) {
+		std::uint32_t& cell = sketch[d * width + mix(key + d) % width];
+		if (cell == est)
+			cell++;
+	}
+	return est + 1;
+}
+
+void SketchQuoter::trackWord(std::uint64_t key, const std::string& word) {
+	std::uint32_t count = sketchAdd(wordSketch, key);
+	std::unordered_map<std::uint64_t, std::uint32_t>::iterator it =
+		entryIndex.find(key);
+	if (it != entryIndex.end()) {
+		entries[it->second].count = count;
+		if (it->second == minEntry)
+			minValid = false;
+		return;
+	}
+
+	std::size_t slot;
+	if (entries.size() < (std::size_t)Markers::NUM_ITEMS + maxWords) {
+		slot = entries.size();
+		entries.push_back(Entry());
+		minValid = false;
+	} else {
+		// Evict the least frequent word if this one has overtaken it.
+		slot = findMinEntry();
+		if (slot >= entries.size() || count <= entries[slot].count)
+			return;
+		entryIndex.erase(entries[slot].key);
+		minValid = false;
+	}
+
+	Entry& e = entries[slot];
+	e.key = key;
+	e.word = word;
+	e.count = count;
+	e.successors.clear();
+	entryIndex[key] = slot;
+}
+
+void SketchQuoter::trackPair(std::uint64_t prev, std::uint64_t next) {
+	std::uint32_t count = sketchAdd(pairSketch, mix(prev) ^ next);
+	std::unordered_map<std::uint64_t, std::uint32_t>::iterator it =
+		entryIndex.find(prev);
+	if (it == entryIndex.end())
+		return;
+
+	std::vector<Successor>& succ = entries[it->second].successors;
+	std::vector<Successor>::iterator s, min = succ.end();
+	for (s = succ.begin(); s != succ.end(); ++s) {
+		if (s->key == next) {
+			s->count = count;
+			return;
+		}
+		if (min == succ.end() || s->count < min->count)
+			min = s;
+	}
+
+	Successor newSucc;
+	newSucc.key = next;
+	newSucc.count = count;
+	if (succ.size() < maxSuccessors)
+		succ.push_back(newSucc);
+	else if (count > min->count)
+		*min = newSucc;
+}
+
+void SketchQuoter::countItems(std::vector<Tokenizer::Item>& items,
+			      std::uint64_t& lastKey, bool& haveLast) {
+	std::vector<Tokenizer::Item>::iterator it;
+	for (it = items.begin(); it != items.end(); ++it) {
+		std::uint64_t key = itemKey(*it);
+		if (it->type == Tokenizer::ItemTypes::WORD)
+			trackWord(key, it->word);
+		if (haveLast)
+			trackPair(lastKey, key);
+		lastKey = key;
+		haveLast = true;
+	}
+}
+
+std::size_t SketchQuoter::findMinEntry() {
+	if (!minValid) {
+		minEntry = entries.size();
+		for (std::size_t i = (std::size_t)Markers::NUM_ITEMS;
+		     i < entries.size(); i++)
+			if (minEntry == entries.size() ||
+			    entries[i].count < entries[minEntry].count)
+				minEntry = i;
+		minValid = true;
+	}
+	return minEntry;
+}
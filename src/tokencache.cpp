@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "quoter.hpp"
+#include "runfile.hpp"
+#include "tokencache.hpp"
+#include "tokenizer.hpp"
+
+static const char CACHE_MAGIC[4] = {'B', 'Q', 'T', 'C'};
+static const std::uint32_t CACHE_VERSION = 2;
+
+// Most ids in a chunk.
+static const std::size_t CHUNK_IDS = 1 << 18;
+
+// Most bytes the varint of a 32-bit id takes.
+static const std::size_t MAX_ID_BYTES = 5;
+
+TokenCache::TokenCache(const std::string& source):
+	filename(cachePath(source)),
+	in(filename, std::ios::binary),
+	remaining(0) {
+	if (!in.is_open()) {
+		std::string m = "Error in TokenCache: Cannot open file '";
+		m += filename;
+		m += "' for reading";
+		throw QuoterError(m);
+	}
+
+	Header header;
+	if (!readHeader(in, header) || !matches(header, sourceHeader(source))) {
+		std::string m = "Error in TokenCache: Cache '";
+		m += filename;
+		m += "' is out of date";
+		throw QuoterError(m);
+	}
+
+	// Read the dictionary, then go back to the ids.
+	in.seekg(header.dictOffset);
+	dictionary.reserve(header.wordCount);
+	std::uint32_t len;
+	std::string word;
+	for (std::uint32_t i = 0; i < header.wordCount; i++) {
+		in.read((char *)&len, sizeof(len));
+		word.resize(len);
+		if (len)
+			in.read(&word[0], len);
+		if (!in) {
+			std::string m = "Error in TokenCache: Cache '";
+			m += filename;
+			m += "' is corrupt: Dictionary is truncated";
+			throw QuoterError(m);
+		}
+		dictionary.push_back(word);
+	}
+	in.seekg(sizeof(Header));
+	remaining = header.tokenCount;
+}
+
+bool TokenCache::read(std::vector<std::uint32_t>& ids) {
+	ids.clear();
+	if (remaining == 0)
+		return false;
+
+	std::uint32_t count = 0, bytes = 0;
+	in.read((char *)&count, sizeof(count));
+	in.read((char *)&bytes, sizeof(bytes));
+	bool ok = in && count != 0 && count <= remaining &&
+		count <= CHUNK_IDS && bytes >= count &&
+		bytes <= count * MAX_ID_BYTES;
+	if (ok) {
+		chunk.resize(bytes);
+		in.read(&chunk[0], bytes);
+		ok = (bool)in;
+	}
+	if (!ok) {
+		std::string m = "Error in TokenCache: Cache '";
+		m += filename;
+		m += "' is corrupt: Ids are truncated";
+		throw QuoterError(m);
+	}
+
+	std::size_t pos = 0;
+	std::uint64_t id;
+	while (ok && ids.size() < count) {
+		ok = getVarint(chunk.data(), bytes, pos, id) && id <= UINT32_MAX;
+		ids.push_back(id);
+	}
+	if (!ok || pos != bytes) {
+		std::string m = "Error in TokenCache: Cache '";
+		m += filename;
+		m += "' is corrupt: Bad ids";
+		throw QuoterError(m);
+	}
+	remaining -= count;
+	return true;
+}
+
+const std::vector<std::string>& TokenCache::words() const {
+	return dictionary;
+}
+
+void TokenCache::build(const std::string& source) {
+	Header header = sourceHeader(source);
+	std::ifstream src(source);
+	if (!src.is_open()) {
+		std::string m = "Error in TokenCache::build: Could not open ";
+		m += source;
+		throw QuoterError(m);
+	}
+
+	// Write to a temporary file first, so an interrupted build
+	// never leaves a cache behind that looks complete.
+	std::string path = cachePath(source), tmpPath = path + ".tmp";
+	std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::string m = "Error in TokenCache::build: Cannot open file '";
+		m += tmpPath;
+		m += "' for writing";
+		throw QuoterError(m);
+	}
+	out.write((const char *)&header, sizeof(header));
+
+	std::vector<std::string> words((std::size_t)Tokenizer::Markers::NUM_ITEMS);
+	std::unordered_map<std::string, std::uint32_t> index;
+	std::vector<std::uint32_t> ids;
+	ids.reserve(CHUNK_IDS);
+	std::string chunk;
+	std::function<void()> flush = [&]() {
+		chunk.clear();
+		std::vector<std::uint32_t>::iterator id;
+		for (id = ids.begin(); id != ids.end(); ++id)
+			putVarint(chunk, *id);
+		std::uint32_t count = ids.size(), bytes = chunk.size();
+		out.write((const char *)&count, sizeof(count));
+		out.write((const char *)&bytes, sizeof(bytes));
+		out.write(chunk.data(), bytes);
+		header.tokenCount += count;
+		ids.clear();
+	};
+	std::vector<Tokenizer::Item> items;
+	Tokenizer tokenizer;
+	std::string raw;
+	bool more = true;
+	while (more) {
+		if (src >> raw) {
+			Tokenizer::Word word = Tokenizer::scan(raw);
+			tokenizer.push(word, items);
+		} else {
+			tokenizer.finish(items);
+			more = false;
+		}
+
+		std::vector<Tokenizer::Item>::iterator it;
+		for (it = items.begin(); it != items.end(); ++it) {
+			std::uint32_t id;
+			if (it->type == Tokenizer::ItemTypes::MARKER) {
+				id = (std::uint32_t)it->marker;
+			} else {
+				std::unordered_map<std::string, std::uint32_t>::iterator w =
+					index.find(it->word);
+				if (w == index.end()) {
+					id = words.size();
+					index[it->word] = id;
+					words.push_back(it->word);
+				} else {
+					id = w->second;
+				}
+			}
+			ids.push_back(id);
+			if (ids.size() == CHUNK_IDS)
+				flush();
+		}
+		items.clear();
+	}
+	if (!ids.empty())
+		flush();
+
+	header.dictOffset = out.tellp();
+	header.wordCount = words.size();
+	std::vector<std::string>::iterator w;
+	for (w = words.begin(); w != words.end(); ++w) {
+		std::uint32_t len = w->size();
+		out.write((const char *)&len, sizeof(len));
+		out.write(w->data(), len);
+	}
+	out.seekp(0);
+	out.write((const char *)&header, sizeof(header));
+	out.close();
+
+	if (out.fail() || !matches(header, sourceHeader(source)) ||
+	    std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+		std::remove(tmpPath.c_str());
+		std::string m = "Error in TokenCache::build: Could not write '";
+		m += path;
+		m += "'";
+		throw QuoterError(m);
+	}
+}
+
+bool TokenCache::isFresh(const std::string& source) {
+	std::ifstream cache(cachePath(source), std::ios::binary);
+	Header header;
+	try {
+		return cache.is_open() && readHeader(cache, header) &&
+			matches(header, sourceHeader(source));
+	} catch (const QuoterError&) {
+		return false;
+	}
+}
+
+std::string TokenCache::cachePath(const std::string& source) {
+	return source + ".bqt";
+}
+
+TokenCache::SourceStamp TokenCache::sourceStamp(const std::string& source) {
+	static const std::uint64_t fingerprint = Tokenizer::fingerprint();
+	struct stat st;
+	if (stat(source.c_str(), &st) != 0) {
+		std::string m = "Error in TokenCache: Cannot stat ";
+		m += source;
+		throw QuoterError(m);
+	}
+
+	SourceStamp stamp;
+	stamp.fingerprint = fingerprint;
+	stamp.size = st.st_size;
+	stamp.mtimeSec = st.st_mtim.tv_sec;
+	stamp.mtimeNsec = st.st_mtim.tv_nsec;
+	return stamp;
+}
+
+TokenCache::Header TokenCache::sourceHeader(const std::string& source) {
+	Header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.source = sourceStamp(source);
+	return header;
+}
+
+bool TokenCache::readHeader(std::ifstream& cache, Header& header) {
+	cache.read((char *)&header, sizeof(header));
+	return cache.gcount() == sizeof(header);
+}
+
+bool TokenCache::matches(const Header& a, const Header& b) {
+	return std::memcmp(a.magic, b.magic, sizeof(a.magic)) == 0 &&
+		a.version == b.version &&
+		a.source.fingerprint == b.source.fingerprint &&
+		a.source.size == b.source.size &&
+		a.source.mtimeSec == b.source.mtimeSec &&
+		a.source.mtimeNsec == b.source.mtimeNsec;
+}
@@ -0,0 +1,154 @@
+#include <cctype>
+#include <utility>
+#include "hash.hpp"
+#include "tokenizer.hpp"
+
+Tokenizer::Tokenizer():
+	start_of_sentence(true),
+	start_pending(false),
+	last_was_word(false) {}
+
+Tokenizer::Word Tokenizer::scan(const std::string& raw) {
+	Word w;
+	bool period = false, exclaim = false, question = false;
+	w.text.reserve(raw.size());
+	for (std::string::const_iterator it = raw.begin();
+	     it != raw.end(); ++it) {
+		if (*it == '.')
+			period = true;
+		else if (*it == '!')
+			exclaim = true;
+		else if (*it == '?')
+			question = true;
+		else if (keepChar(*it))
+			w.text += *it;
+	}
+
+	if (period)
+		w.end = Markers::PERIOD;
+	else if (exclaim)
+		w.end = Markers::EXCLAIM;
+	else if (question)
+		w.end = Markers::QUESTION;
+	else
+		w.end = Markers::NUM_ITEMS;
+
+	return w;
+}
+
+void Tokenizer::push(Word& word, std::vector<Item>& items) {
+	if (start_of_sentence) {
+		start_pending = true;
+		start_of_sentence = false;
+	}
+	if (!word.text.empty()) {
+		if (start_pending) {
+			items.push_back(marker(Markers::START));
+			start_pending = false;
+		}
+		Item newWord;
+		newWord.type = ItemTypes::WORD;
+		newWord.marker = Markers::NUM_ITEMS;
+		newWord.word = std::move(word.text);
+		items.push_back(std::move(newWord));
+		last_was_word = true;
+	}
+	// Make sure at least one word is in the current sentence
+	// if it is being ended.
+	if (word.end != Markers::NUM_ITEMS && !start_pending) {
+		items.push_back(marker(word.end));
+		start_of_sentence = true;
+		last_was_word = false;
+	}
+}
+
+void Tokenizer::finish(std::vector<Item>& items) {
+	// An empty trailing sentence is dropped along with its START
+	// marker. An unterminated one is ended with a period.
+	if (!start_pending && last_was_word)
+		items.push_back(marker(Markers::PERIOD));
+
+	start_of_sentence = true;
+	start_pending = false;
+	last_was_word = false;
+}
+
+Tokenizer::State Tokenizer::state() const {
+	State s;
+	s.start_of_sentence = start_of_sentence;
+	s.start_pending = start_pending;
+	s.last_was_word = last_was_word;
+	return s;
+}
+
+void Tokenizer::restore(const State& s) {
+	start_of_sentence = s.start_of_sentence;
+	start_pending = s.start_pending;
+	last_was_word = s.last_was_word;
+}
+
+std::string Tokenizer::filterWord(const std::string& word) {
+	std::string filtered;
+	filtered.reserve(word.size());
+	for (std::string::const_iterator it = word.begin();
+	     it != word.end(); ++it)
+		if (keepChar(*it))
+			filtered += *it;
+
+	return filtered;
+}
+
+std::uint64_t Tokenizer::fingerprint() {
+	static const char *samples[] = {
+		"A sentence. Another one! And a question? ",
+		"... ! ?! lone words without an end",
+		"It's #1, e-mail me@here. 'Quoted' (text)?",
+		"Ends on a marker.",
+	};
+
+	// 64-bit FNV-1a over the items produced.
+	std::uint64_t h = FNV1A_BASIS;
+	std::vector<Item> items;
+	for (int c = 1; c < 256; c++) {
+		Word w = scan(std::string(1, (char)c));
+		w.text += (char)w.end;
+		h = fnv1a(w.text, h);
+	}
+	for (std::size_t i = 0; i < sizeof(samples) / sizeof(*samples); i++) {
+		Tokenizer tokenizer;
+		std::string raw, text(samples[i]);
+		std::string::size_type start = 0, end;
+		while (start < text.size()) {
+			end = text.find(' ', start);
+			if (end == std::string::npos)
+				end = text.size();
+			raw = text.substr(start, end - start);
+			start = end + 1;
+			if (raw.empty())
+				continue;
+			Word w = scan(raw);
+			tokenizer.push(w, items);
+		}
+		tokenizer.finish(items);
+	}
+	std::vector<Item>::iterator it;
+	for (it = items.begin(); it != items.end(); ++it) {
+		std::string repr = it->word;
+		repr += (char)it->type;
+		repr += (char)it->marker;
+		h = fnv1a(repr, h);
+	}
+	return h;
+}
+
+bool Tokenizer::keepChar(char c) {
+	return isalnum((unsigned char)c) || (c >= '#' && c <= '\'') ||
+		(c == ',') || (c == '-') || (c == '@');
+}
+
+Tokenizer::Item Tokenizer::marker(Markers m) {
+	Item newMarker;
+	newMarker.type = ItemTypes::MARKER;
+	newMarker.marker = m;
+	return newMarker;
+}